@@ -0,0 +1,127 @@
+// Host build of the Arduino core for the replay and time warp harness,
+// only what the firmware uses, driven by the simulation in sim.cpp
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define SDA 18
+#define SCL 19
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define memcpy_P memcpy
+
+#define _BV(bit) (1 << (bit))
+#define ISR(vector) extern "C" void vector(void)
+#define EMPTY_INTERRUPT(vector) extern "C" void vector(void) {}
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+class __FlashStringHelper;
+
+// registers used by the firmware, the simulation reads them to decide
+// which interrupts are enabled
+
+extern volatile uint8_t SREG;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+extern volatile uint16_t OCR1A;
+extern volatile uint8_t EIMSK, EIFR, PCICR, PCIFR, PCMSK0, PCMSK1, PCMSK2;
+extern volatile uint8_t ADMUX, ADCSRA;
+extern volatile uint16_t ADC;
+
+#define WGM12 3
+#define CS10 0
+#define CS11 1
+#define OCIE1A 1
+#define INT0 0
+#define INT1 1
+#define INTF0 0
+#define INTF1 1
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+#define REFS0 6
+#define ADSC 6
+#define ADIE 3
+
+// pin change interrupt mapping of the ATmega328P
+
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : -1))
+#define digitalPinToPCICR(p) (&PCICR)
+#define digitalPinToPCICRbit(p) ((p) <= 7 ? 2 : ((p) <= 13 ? 0 : 1))
+#define digitalPinToPCMSK(p) ((p) <= 7 ? &PCMSK2 : ((p) <= 13 ? &PCMSK0 : &PCMSK1))
+#define digitalPinToPCMSKbit(p) ((p) <= 7 ? (p) : ((p) <= 13 ? (p) - 8 : (p) - 14))
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+void noInterrupts();
+void interrupts();
+
+class String
+{
+public:
+  String() {}
+  String(const char *text) : value(text) {}
+  String(double number, unsigned char decimals);
+  bool concat(const char *text) { value += text; return true; }
+  unsigned int length() const { return value.length(); }
+  const char *c_str() const { return value.c_str(); }
+
+private:
+  std::string value;
+};
+
+class HardwareSerial
+{
+public:
+  void begin(unsigned long baudrate) {}
+  int available();
+  int read();
+  void flush() {}
+  size_t write(uint8_t data);
+  size_t print(const char *text);
+  size_t print(const __FlashStringHelper *text);
+  size_t print(char c);
+  size_t print(long value);
+  size_t print(unsigned long value);
+  size_t print(int value) { return print((long)value); }
+  size_t print(unsigned int value) { return print((unsigned long)value); }
+  size_t println();
+};
+
+extern HardwareSerial Serial;
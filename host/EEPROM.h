@@ -0,0 +1,32 @@
+// Host build: EEPROM in memory, erased like a new device
+
+#pragma once
+
+#include <Arduino.h>
+
+class EEPROMClass
+{
+public:
+  EEPROMClass() { memset(data, 0xFF, sizeof(data)); }
+
+  uint8_t read(int address) { return data[address]; }
+  void write(int address, uint8_t value) { data[address] = value; }
+  void update(int address, uint8_t value) { data[address] = value; }
+  uint16_t length() const { return sizeof(data); }
+
+  template <class T> T &get(int address, T &value)
+  {
+    memcpy(&value, &data[address], sizeof(T));
+    return value;
+  }
+
+  template <class T> const T &put(int address, const T &value)
+  {
+    memcpy(&data[address], &value, sizeof(T));
+    return value;
+  }
+
+  uint8_t data[1024];
+};
+
+extern EEPROMClass EEPROM;
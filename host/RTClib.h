@@ -0,0 +1,40 @@
+// Host build: the parts of RTClib used by the firmware, RTC_DS3231 works
+// on the simulated DS3231 and DateTime is an independent implementation
+// of the calendar, so it can be used as reference for the firmware
+
+#pragma once
+
+#include <Arduino.h>
+
+enum Ds3231SqwPinMode { DS3231_OFF = 0x1C, DS3231_SquareWave1Hz = 0x00 };
+
+class DateTime
+{
+public:
+  DateTime(uint32_t t = 0);
+  DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour = 0, uint8_t minute = 0, uint8_t second = 0);
+  DateTime(const __FlashStringHelper *date, const __FlashStringHelper *time);
+
+  uint16_t year() const { return y; }
+  uint8_t month() const { return m; }
+  uint8_t day() const { return d; }
+  uint8_t hour() const { return hh; }
+  uint8_t minute() const { return mm; }
+  uint8_t second() const { return ss; }
+  uint8_t dayOfTheWeek() const;
+  uint32_t unixtime() const;
+
+private:
+  uint16_t y;
+  uint8_t m, d, hh, mm, ss;
+};
+
+class RTC_DS3231
+{
+public:
+  bool begin();
+  bool lostPower();
+  void adjust(const DateTime &dt);
+  void writeSqwPinMode(Ds3231SqwPinMode mode);
+  float getTemperature();
+};
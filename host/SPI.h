@@ -0,0 +1,25 @@
+// Host build: SPI with the shift registers of the display bus, simulated
+// in sim.cpp
+
+#pragma once
+
+#include <Arduino.h>
+
+#define MSBFIRST 1
+#define SPI_MODE0 0
+
+struct SPISettings
+{
+  SPISettings(unsigned long clock, uint8_t order, uint8_t mode) {}
+};
+
+class SPIClass
+{
+public:
+  void begin();
+  void beginTransaction(SPISettings settings) {}
+  uint16_t transfer16(uint16_t data);
+  void endTransaction() {}
+};
+
+extern SPIClass SPI;
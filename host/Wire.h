@@ -0,0 +1,38 @@
+// Host build: I2C bus with the simulated DS3231 at address 0x68 and the
+// MCP23017 of the display bus at 0x20
+
+#pragma once
+
+#include <Arduino.h>
+
+#define WIRE_HAS_TIMEOUT
+
+class TwoWire
+{
+public:
+  TwoWire() : clock(100000) {}
+  void begin() { clock = 100000; }
+  void end() {}
+  void setClock(unsigned long value) { clock = value; }
+  unsigned long getClock() const { return clock; }
+  void setWireTimeout(unsigned long timeout, bool reset) {}
+  bool getWireTimeoutFlag() { return false; }
+  void clearWireTimeoutFlag() {}
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t data);
+  uint8_t endTransmission();
+  uint8_t requestFrom(uint8_t address, uint8_t length);
+  int read();
+
+private:
+  void transfer(uint8_t bytes);
+
+  unsigned long clock;
+  uint8_t address;
+  uint8_t buffer[32];
+  uint8_t length;
+  uint8_t readPos;
+  uint8_t readLength;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,12 @@
+// Host build: sleeping advances the simulated time to the next interrupt
+
+#pragma once
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_ADC 1
+#define SLEEP_MODE_PWR_DOWN 2
+
+void set_sleep_mode(int mode);
+void sleep_cpu();
+inline void sleep_enable() {}
+inline void sleep_disable() {}
@@ -0,0 +1,87 @@
+// Cost of the display bus backends with simulated hardware
+//
+// Runs the time display with the simulated bus timing of the backend
+// selected at build time (DISPLAY_BUS_SHIFT_REGISTER,
+// DISPLAY_BUS_PORT_EXPANDER or GPIO) and prints the average time per
+// character and the update latency reported by the firmware statistics.
+// The display is checked 3/4 of a second after every second, so a
+// backend which does not decode correctly fails.
+//
+// Usage: buscost [SECONDS]
+//
+// SECONDS is the time to run from 2024-01-01 00:00 UTC, default one hour,
+// enough for more writes than the averaging window of the firmware.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+#include <EEPROM.h>
+#include <RTClib.h>
+#include <Wire.h>
+
+#if defined(DISPLAY_BUS_SHIFT_REGISTER)
+static const char BACKEND[] = "shift register";
+#elif defined(DISPLAY_BUS_PORT_EXPANDER)
+static const char BACKEND[] = "port expander";
+#else
+static const char BACKEND[] = "gpio";
+#endif
+
+const uint32_t START = 1704067200UL;
+
+const int STORAGE_TIME_ZONE = 4;
+
+// last value of a statistic in the serial output, -1 if missing
+
+static long lastStat(const std::string &output, const char *name)
+{
+  std::string key = std::string(" ") + name + "=";
+  size_t pos = output.rfind(key);
+  if (std::string::npos == pos) {
+    return -1;
+  }
+  return strtol(output.c_str() + pos + key.size(), NULL, 10);
+}
+
+int main(int argc, char **argv)
+{
+  int seconds = argc > 1 ? atoi(argv[1]) : 3600;
+  if (seconds < 10) {
+    fprintf(stderr, "Usage: buscost [SECONDS], at least 10 seconds\n");
+    return 1;
+  }
+
+  EEPROM.write(STORAGE_TIME_ZONE, 0);
+  simRTCSet(START);
+  setup();
+
+  unsigned long checks = 0;
+  unsigned long errors = 0;
+  std::string output;
+
+  while (simRTCTime() < START + seconds) {
+    simRun(simNextEdge() + 750000);
+    output += simSerialOutput();
+
+    DateTime now(simRTCTime());
+    char expected[16];
+    snprintf(expected, sizeof(expected), "%02d:%02d:%02d", now.hour(), now.minute(), now.second());
+    checks++;
+    if (strcmp(expected, simDisplay()) != 0) {
+      errors++;
+      if (errors <= 20) {
+        printf("%02d:%02d:%02d expected [%s], shown [%s]\n",
+          now.hour(), now.minute(), now.second(), expected, simDisplay());
+      }
+    }
+  }
+
+  printf("%s, i2c %lu Hz: char_us %ld, latency_us %ld, latency_max_us %ld\n", BACKEND,
+    Wire.getClock(), lastStat(output, "char_us"), lastStat(output, "latency_us"),
+    lastStat(output, "latency_max_us"));
+  printf("checks %lu, errors %lu\n", checks, errors);
+  return errors ? 1 : 0;
+}
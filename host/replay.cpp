@@ -0,0 +1,200 @@
+// Replay of an event trace recorded with ALPHACLOCK_TRACE
+//
+// Feeds the button changes and SQW edges of the trace into the firmware
+// at their recorded times and prints the resulting display frames with
+// the time since the last input, so changes in the time and button
+// handling can be compared against a trace of the real clock.
+//
+// Usage: replay TRACE.bin [UNIXTIME]
+//
+// The RTC starts at the first full RTC read in the trace (recorded with
+// ALPHACLOCK_TRACE_RTC) or at the given time in UTC. The boot latency is
+// the simulated time from reset until the first time frame was shown.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "sim.h"
+
+// event types as in src/main.cpp
+
+const uint8_t TRACE_IDLE = 0;
+const uint8_t TRACE_BUTTON1 = 1;
+const uint8_t TRACE_BUTTON2 = 2;
+const uint8_t TRACE_SQW = 3;
+const uint8_t TRACE_RTC_READ = 4;
+const uint8_t TRACE_RTC_NEXT = 5;
+
+struct TraceEvent
+{
+  uint64_t time;
+  uint8_t type;
+  uint32_t value;
+};
+
+// set by the firmware when the time is shown for the first time
+
+extern unsigned long bootLatency;
+
+static std::vector<TraceEvent> events;
+static size_t printed = 0;
+static std::string lastFrame;
+static uint64_t lastInput = 0;
+static bool bootPrinted = false;
+
+static bool readTrace(const char *name)
+{
+  FILE *file = fopen(name, "rb");
+  if (!file) {
+    perror(name);
+    return false;
+  }
+  std::vector<uint8_t> trace;
+  int c;
+  while (EOF != (c = fgetc(file))) {
+    trace.push_back(c);
+  }
+  fclose(file);
+
+  uint64_t time = 0;
+  size_t pos = 0;
+  while (pos + 3 <= trace.size()) {
+    TraceEvent event;
+    time += trace[pos] | trace[pos + 1] << 8;
+    event.time = time * 1000;
+    event.type = trace[pos + 2];
+    event.value = 0;
+    pos += 3;
+
+    size_t length;
+    switch (event.type) {
+      case TRACE_IDLE:
+      case TRACE_SQW:
+      case TRACE_RTC_NEXT:
+        length = 0;
+        break;
+      case TRACE_BUTTON1:
+      case TRACE_BUTTON2:
+        length = 1;
+        break;
+      case TRACE_RTC_READ:
+        length = 4;
+        break;
+      default:
+        fprintf(stderr, "%s: unknown event %d at offset %zu\n", name, event.type, pos - 3);
+        return false;
+    }
+    if (pos + length > trace.size()) {
+      fprintf(stderr, "%s: truncated event at offset %zu\n", name, pos - 3);
+      return false;
+    }
+    for (size_t i=0; i<length; i++) {
+      event.value |= (uint32_t)trace[pos++] << (8 * i);
+    }
+    if (TRACE_IDLE != event.type) {
+      events.push_back(event);
+    }
+  }
+  return true;
+}
+
+// print inputs up to the given time
+
+static void printInputs(uint64_t until)
+{
+  static const char *NAMES[] = { "", "BTN1", "BTN2", "SQW", "RTC", "RTC+1" };
+
+  while (printed < events.size() && events[printed].time <= until) {
+    const TraceEvent &event = events[printed++];
+    printf("%10.3f  %-5s", event.time / 1000.0, NAMES[event.type]);
+    if (TRACE_BUTTON1 == event.type || TRACE_BUTTON2 == event.type) {
+      printf(" %s", event.value ? "up" : "down");
+    } else if (TRACE_RTC_READ == event.type) {
+      printf(" %u", event.value);
+    }
+    printf("\n");
+    if (TRACE_RTC_READ != event.type && TRACE_RTC_NEXT != event.type) {
+      lastInput = event.time;
+    }
+  }
+}
+
+static void printOutput()
+{
+  std::string serial = simSerialOutput();
+  if (!serial.empty()) {
+    printInputs(simTime());
+    printf("%10.3f  serial ", simTime() / 1000.0);
+    for (size_t i=0; i<serial.size(); i++) {
+      uint8_t c = serial[i];
+      if (c >= 0x20 && c < 0x7F) {
+        putchar(c);
+      } else {
+        printf("\\x%02X", c);
+      }
+    }
+    printf("\n");
+  }
+
+  std::string frame = simDisplay();
+  if (frame != lastFrame) {
+    printInputs(simLastWrite());
+    printf("%10.3f  frame [%s] %+.3f ms, brightness %d\n", simLastWrite() / 1000.0,
+      frame.c_str(), (simLastWrite() - lastInput) / 1000.0, simBrightness());
+    lastFrame = frame;
+  }
+
+  if (!bootPrinted && 0 != bootLatency) {
+    printf("%10.3f  boot latency %lu us\n", simTime() / 1000.0, bootLatency);
+    bootPrinted = true;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: replay TRACE.bin [UNIXTIME]\n");
+    return 1;
+  }
+  if (!readTrace(argv[1])) {
+    return 1;
+  }
+
+  // the RTC time at the start is the first full read minus the seconds
+  // counted until then
+
+  uint32_t start = argc > 2 ? strtoul(argv[2], NULL, 10) : 1704067200;
+  uint32_t edges = 0;
+  for (size_t i=0; i<events.size(); i++) {
+    if (TRACE_SQW == events[i].type) {
+      edges++;
+    } else if (TRACE_RTC_READ == events[i].type) {
+      start = events[i].value - edges;
+      break;
+    }
+  }
+  simRTCSet(start);
+
+  uint64_t end = 0;
+  for (size_t i=0; i<events.size(); i++) {
+    if (TRACE_BUTTON1 == events[i].type || TRACE_BUTTON2 == events[i].type) {
+      simButton(events[i].time, events[i].type, events[i].value);
+    } else if (TRACE_SQW == events[i].type) {
+      simRTCExternalEdge(events[i].time);
+    }
+    end = events[i].time;
+  }
+
+  setup();
+  printOutput();
+  simRun(end + 2000000, printOutput);
+  printInputs(end);
+
+  if (!bootPrinted) {
+    printf("%10.3f  no time frame shown, no boot latency\n", simTime() / 1000.0);
+  }
+  printf("%10.3f  end, RTC %u\n", simTime() / 1000.0, simRTCTime());
+  return 0;
+}
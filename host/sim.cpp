@@ -0,0 +1,779 @@
+// Simulation of the clock hardware for the host harness
+
+#include <map>
+#include <vector>
+
+#include "sim.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <RTClib.h>
+#include <SPI.h>
+#include <Wire.h>
+#include <avr/sleep.h>
+
+extern "C" {
+  void TIMER1_COMPA_vect(void) __attribute__((weak));
+  void PCINT0_vect(void) __attribute__((weak));
+  void PCINT2_vect(void) __attribute__((weak));
+  void ADC_vect(void) __attribute__((weak));
+}
+
+volatile uint8_t SREG;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+volatile uint16_t OCR1A;
+volatile uint8_t EIMSK, EIFR, PCICR, PCIFR, PCMSK0, PCMSK1, PCMSK2;
+volatile uint8_t ADMUX, ADCSRA;
+volatile uint16_t ADC;
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+SPIClass SPI;
+TwoWire Wire;
+
+// display wiring as in src/main.cpp
+
+static const int DATA_PINS[7] = { 7, 13, A2, A3, 4, 11, 6 };
+static const int D_A0 = 8;
+static const int D_A1 = 9;
+static const int D_WR = 10;
+static const int D_CE2 = A1;
+
+static const uint32_t DAY_SECONDS = 86400;
+
+static uint64_t now = 0;
+static uint64_t frozen = 0;
+static int64_t millisOffset = 0;
+static bool poweredDown = false;
+static int sleepMode = SLEEP_MODE_IDLE;
+
+static uint8_t pins[20];
+static void (*intHandlers[2])(void);
+
+static uint64_t nextTimer1 = 0;
+
+static std::multimap<uint64_t, std::pair<int, int> > buttonEvents;
+static std::string serialIn;
+static std::string serialOut;
+
+static bool rtcPresent = true;
+static bool rtcLostPower = false;
+static bool rtcSqw = false;
+static uint32_t rtcBase = 0;
+static uint64_t rtcStart = 0;
+static uint32_t rtcSecondMicros = 1000000;
+static uint32_t rtcSecondStep = 1;
+static bool rtcExternal = false;
+static std::vector<uint64_t> rtcEdges;
+static size_t rtcEdgePos = 0;
+static uint32_t rtcEdgeCount = 0;
+static uint64_t lastEdge = 0;
+static uint8_t rtcPointer = 0;
+
+static char display[9] = "        ";
+static uint64_t lastWrite = 0;
+static int brightness = 0;
+
+// bus timing of the ATmega328P at 16 MHz: a digitalWrite() takes about
+// 3.5 us, a 16 bit SPI transfer at 8 MHz with its setup about 3 us, an
+// I2C transfer 9 bits per byte plus START and STOP at the bus clock and
+// about 5 us in the Wire library
+
+static const uint32_t DIGITAL_WRITE_NANOS = 3500;
+static const uint32_t SPI_TRANSFER_NANOS = 3000;
+static const uint32_t I2C_OVERHEAD_NANOS = 5000;
+static uint32_t busyNanos = 0;
+
+// 74HC595 shift registers: value shifted in and value at the outputs
+
+static bool spiBus = false;
+static uint16_t shiftValue = 0;
+static uint16_t shiftOutputs = 0x1000;
+
+// MCP23017: output registers of port A and B
+
+static const uint8_t MCP23017_ADDRESS = 0x20;
+static uint8_t expanderPorts[2] = { 0x00, 0x10 };
+
+// --------------------------------------------------------------------------
+// Time and interrupts
+// --------------------------------------------------------------------------
+
+uint64_t simTime()
+{
+  return now;
+}
+
+void simSetMillis(uint32_t ms)
+{
+  millisOffset = (int64_t)ms - (int64_t)((now - frozen) / 1000);
+}
+
+unsigned long millis()
+{
+  return (uint32_t)((now - frozen) / 1000 + millisOffset);
+}
+
+unsigned long micros()
+{
+  return (uint32_t)(now - frozen + millisOffset * 1000);
+}
+
+void noInterrupts()
+{
+}
+
+void interrupts()
+{
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode)
+{
+  intHandlers[interrupt] = handler;
+  EIMSK |= _BV(interrupt);
+}
+
+void detachInterrupt(uint8_t interrupt)
+{
+  intHandlers[interrupt] = NULL;
+  EIMSK &= ~_BV(interrupt);
+}
+
+static bool sqwLevel()
+{
+  if (!rtcPresent || !rtcSqw) {
+    return HIGH;
+  }
+  if (rtcExternal) {
+    // low for 500 ms after each given edge
+    return !(rtcEdgePos > 0 && now < rtcEdges[rtcEdgePos - 1] + 500000);
+  }
+  return (now - rtcStart) % rtcSecondMicros >= rtcSecondMicros / 2;
+}
+
+static void pinChanged(int pin)
+{
+  volatile uint8_t *mask = digitalPinToPCMSK(pin);
+  int group = digitalPinToPCICRbit(pin);
+  if (!(PCICR & _BV(group)) || !(*mask & _BV(digitalPinToPCMSKbit(pin)))) {
+    return;
+  }
+  if (0 == group && PCINT0_vect) {
+    PCINT0_vect();
+  } else if (2 == group && PCINT2_vect) {
+    PCINT2_vect();
+  }
+}
+
+static void sqwFalling()
+{
+  lastEdge = now;
+  if (rtcExternal) {
+    rtcEdgeCount++;
+  }
+
+  // edge interrupts need the I/O clock, so INT1 misses them in power down
+
+  if (!poweredDown && (EIMSK & _BV(INT1)) && intHandlers[1]) {
+    intHandlers[1]();
+  }
+  pinChanged(SIM_RTC_PIN);
+}
+
+// next SQW edge after the current time, 0 if there is none
+
+static uint64_t nextSqwEdge(bool *falling)
+{
+  if (!rtcPresent || !rtcSqw) {
+    return 0;
+  }
+  if (rtcExternal) {
+    uint64_t fall = rtcEdgePos < rtcEdges.size() ? rtcEdges[rtcEdgePos] : 0;
+    uint64_t rise = rtcEdgePos > 0 ? rtcEdges[rtcEdgePos - 1] + 500000 : 0;
+    if (rise <= now || (fall && fall < rise)) {
+      rise = 0;
+    }
+    *falling = 0 == rise;
+    return rise ? rise : fall;
+  }
+  uint64_t half = rtcSecondMicros / 2;
+  uint64_t phase = (now - rtcStart) % rtcSecondMicros;
+  if (phase < half) {
+    *falling = false;
+    return now - phase + half;
+  }
+  *falling = true;
+  return now - phase + rtcSecondMicros;
+}
+
+// advance the virtual time and handle all events until then, in power
+// down only the SQW output and the buttons can wake up the CPU
+
+static void advance(uint64_t until, bool wake)
+{
+  while (true) {
+    uint64_t next = until;
+    int source = 0;
+
+    bool timerRunning = (TIMSK1 & _BV(OCIE1A)) && !poweredDown;
+    if (timerRunning) {
+      if (0 == nextTimer1) {
+        nextTimer1 = now + (OCR1A + 1) * 4;
+      }
+      if (nextTimer1 < next) {
+        next = nextTimer1;
+        source = 1;
+      }
+    }
+    // an edge at the same time as the timer goes first, the edge would
+    // be lost otherwise
+
+    bool falling = false;
+    uint64_t edge = nextSqwEdge(&falling);
+    if (edge && edge <= next) {
+      next = edge;
+      source = 2;
+    }
+    if (!buttonEvents.empty() && buttonEvents.begin()->first < next) {
+      next = buttonEvents.begin()->first;
+      source = 3;
+    }
+
+    if (poweredDown) {
+      frozen += next - now;
+    }
+    now = next;
+
+    switch (source) {
+      case 0:
+        return;
+      case 1:
+        nextTimer1 += (OCR1A + 1) * 4;
+        if (TIMER1_COMPA_vect) {
+          TIMER1_COMPA_vect();
+        }
+        break;
+      case 2:
+        if (rtcExternal && falling) {
+          rtcEdgePos++;
+        }
+        if (falling) {
+          sqwFalling();
+        } else {
+          pinChanged(SIM_RTC_PIN);
+        }
+        if (wake) {
+          return;
+        }
+        break;
+      case 3:
+      {
+        int pin = buttonEvents.begin()->second.first;
+        pins[pin] = buttonEvents.begin()->second.second;
+        buttonEvents.erase(buttonEvents.begin());
+        pinChanged(pin);
+        if (wake) {
+          return;
+        }
+        break;
+      }
+    }
+    if (!timerRunning) {
+      nextTimer1 = 0;
+    }
+  }
+}
+
+void delay(unsigned long ms)
+{
+  advance(now + ms * 1000, false);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  advance(now + us, false);
+}
+
+// time spent by the CPU on a bus access, in whole microseconds
+
+static void busy(uint32_t nanos)
+{
+  busyNanos += nanos;
+  if (busyNanos >= 1000) {
+    advance(now + busyNanos / 1000, false);
+    busyNanos %= 1000;
+  }
+}
+
+void set_sleep_mode(int mode)
+{
+  sleepMode = mode;
+}
+
+void sleep_cpu()
+{
+  if (SLEEP_MODE_PWR_DOWN == sleepMode) {
+    // wait for the next SQW edge or button change, at most one day
+
+    poweredDown = true;
+    advance(now + DAY_SECONDS * 1000000ULL, true);
+    poweredDown = false;
+    nextTimer1 = 0;
+    return;
+  }
+
+  // the timer 0 overflow wakes up from idle every 1024 us, the ADC
+  // conversion takes 13 ADC clocks of 8 us
+
+  if (ADCSRA & _BV(ADSC)) {
+    advance(now + 104, false);
+    ADCSRA &= ~_BV(ADSC);
+    ADC = 512;
+    if (ADC_vect) {
+      ADC_vect();
+    }
+    return;
+  }
+  advance(now + 1024 - now % 1024, false);
+}
+
+void simRun(uint64_t until, void (*afterLoop)())
+{
+  while (now < until) {
+    uint64_t start = now;
+    loop();
+    if (now == start) {
+      advance(now + 1, false);
+    }
+    if (afterLoop) {
+      afterLoop();
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+// Pins and display bus
+// --------------------------------------------------------------------------
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  // open inputs and released buttons read high
+
+  if (INPUT_PULLUP == mode) {
+    pins[pin] = HIGH;
+  }
+}
+
+// the character is taken over with the rising edge of WR, display 2
+// holds the characters 4-7
+
+static void writeCharacter(int data, int adr, bool display2)
+{
+  if (display2) {
+    adr += 4;
+  }
+  display[7 - adr] = data;
+  lastWrite = now;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  busy(DIGITAL_WRITE_NANOS);
+  bool rising = D_WR == pin && LOW == pins[pin] && HIGH == value;
+  pins[pin] = value;
+  if (!rising) {
+    return;
+  }
+
+  // with the shift registers the pin is their latch
+
+  if (spiBus) {
+    bool wrRising = !(shiftOutputs & 0x1000) && (shiftValue & 0x1000);
+    shiftOutputs = shiftValue;
+    if (wrRising) {
+      writeCharacter(shiftOutputs & 0x7F, (shiftOutputs >> 8) & 0x03, shiftOutputs & 0x0800);
+    }
+    return;
+  }
+
+  int data = 0;
+  for (int i=0; i<7; i++) {
+    data |= pins[DATA_PINS[i]] << i;
+  }
+  writeCharacter(data, pins[D_A0] | pins[D_A1] << 1, HIGH == pins[D_CE2]);
+}
+
+int digitalRead(uint8_t pin)
+{
+  if (SIM_RTC_PIN == pin) {
+    return sqwLevel();
+  }
+  return pins[pin];
+}
+
+void analogWrite(uint8_t pin, int value)
+{
+  if (SIM_PWM_OUT == pin) {
+    brightness = value;
+  }
+}
+
+void simButton(uint64_t time, int button, int level)
+{
+  buttonEvents.insert(std::make_pair(time, std::make_pair(1 == button ? SIM_BTN1 : SIM_BTN2, level)));
+}
+
+const char *simDisplay()
+{
+  return display;
+}
+
+uint64_t simLastWrite()
+{
+  return lastWrite;
+}
+
+int simBrightness()
+{
+  return brightness;
+}
+
+// --------------------------------------------------------------------------
+// SPI with the 74HC595 shift registers of the display bus
+// --------------------------------------------------------------------------
+
+void SPIClass::begin()
+{
+  spiBus = true;
+}
+
+uint16_t SPIClass::transfer16(uint16_t data)
+{
+  busy(SPI_TRANSFER_NANOS);
+  shiftValue = data;
+  return 0;
+}
+
+// --------------------------------------------------------------------------
+// Serial port
+// --------------------------------------------------------------------------
+
+void simSerialInput(const uint8_t *data, size_t length)
+{
+  serialIn.append((const char *)data, length);
+}
+
+std::string simSerialOutput()
+{
+  std::string output = serialOut;
+  serialOut.clear();
+  return output;
+}
+
+int HardwareSerial::available()
+{
+  return serialIn.size();
+}
+
+int HardwareSerial::read()
+{
+  if (serialIn.empty()) {
+    return -1;
+  }
+  uint8_t data = serialIn[0];
+  serialIn.erase(0, 1);
+  return data;
+}
+
+size_t HardwareSerial::write(uint8_t data)
+{
+  serialOut += (char)data;
+  return 1;
+}
+
+size_t HardwareSerial::print(const char *text)
+{
+  serialOut += text;
+  return strlen(text);
+}
+
+size_t HardwareSerial::print(const __FlashStringHelper *text)
+{
+  return print((const char *)text);
+}
+
+size_t HardwareSerial::print(char c)
+{
+  return write(c);
+}
+
+size_t HardwareSerial::print(long value)
+{
+  return print(std::to_string(value).c_str());
+}
+
+size_t HardwareSerial::print(unsigned long value)
+{
+  return print(std::to_string(value).c_str());
+}
+
+size_t HardwareSerial::println()
+{
+  return print("\r\n");
+}
+
+String::String(double number, unsigned char decimals)
+{
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimals, number);
+  value = buffer;
+}
+
+// --------------------------------------------------------------------------
+// DS3231
+// --------------------------------------------------------------------------
+
+void simRTCPresent(bool present)
+{
+  rtcPresent = present;
+}
+
+uint32_t simRTCTime()
+{
+  if (rtcExternal) {
+    return rtcBase + rtcEdgeCount;
+  }
+  return rtcBase + (uint32_t)((now - rtcStart) / rtcSecondMicros) * rtcSecondStep;
+}
+
+void simRTCSet(uint32_t time)
+{
+  // setting the time restarts the second like writing the seconds register
+
+  rtcBase = time;
+  rtcStart = now;
+  rtcEdgeCount = 0;
+  rtcLostPower = false;
+}
+
+void simRTCSpeed(uint32_t secondMicros, uint32_t secondStep)
+{
+  // the current second starts again with the new length
+
+  rtcBase = simRTCTime();
+  rtcStart = now;
+  rtcSecondMicros = secondMicros;
+  rtcSecondStep = secondStep;
+}
+
+void simRTCExternalEdge(uint64_t time)
+{
+  rtcExternal = true;
+  rtcEdges.push_back(time);
+}
+
+uint64_t simLastEdge()
+{
+  return lastEdge;
+}
+
+uint64_t simNextEdge()
+{
+  if (!rtcPresent || !rtcSqw) {
+    return 0;
+  }
+  if (rtcExternal) {
+    return rtcEdgePos < rtcEdges.size() ? rtcEdges[rtcEdgePos] : 0;
+  }
+  return now - (now - rtcStart) % rtcSecondMicros + rtcSecondMicros;
+}
+
+static uint8_t bcd(int value)
+{
+  return value / 10 * 16 + value % 10;
+}
+
+void TwoWire::beginTransmission(uint8_t adr)
+{
+  address = adr;
+  length = 0;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+  if (length < sizeof(buffer)) {
+    buffer[length++] = data;
+  }
+  return 1;
+}
+
+// I2C bus time of a transfer with the given number of data bytes
+
+void TwoWire::transfer(uint8_t bytes)
+{
+  busy(((bytes + 1) * 9 + 2) * 1000000000ULL / clock + I2C_OVERHEAD_NANOS);
+}
+
+// MCP23017 in sequential mode: the register address increments with
+// each byte, WR going high on port B takes over the character
+
+static void expanderWrite(const uint8_t *data, uint8_t length)
+{
+  uint8_t reg = data[0];
+  for (uint8_t i=1; i<length; i++, reg++) {
+    if (0x12 == reg || 0x14 == reg) {
+      expanderPorts[0] = data[i];
+    } else if (0x13 == reg || 0x15 == reg) {
+      bool wrRising = !(expanderPorts[1] & 0x10) && (data[i] & 0x10);
+      expanderPorts[1] = data[i];
+      if (wrRising) {
+        writeCharacter(expanderPorts[0] & 0x7F, expanderPorts[1] & 0x03, expanderPorts[1] & 0x08);
+      }
+    }
+  }
+}
+
+uint8_t TwoWire::endTransmission()
+{
+  if (MCP23017_ADDRESS == address) {
+    transfer(length);
+    if (length > 0) {
+      expanderWrite(buffer, length);
+    }
+    return 0;
+  }
+  if (0x68 != address || !rtcPresent) {
+    // the address is not acknowledged
+
+    transfer(0);
+    return 2;
+  }
+  transfer(length);
+  if (length > 0) {
+    rtcPointer = buffer[0];
+  }
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t adr, uint8_t count)
+{
+  readPos = 0;
+  readLength = 0;
+  if (0x68 != adr || !rtcPresent) {
+    transfer(0);
+    return 0;
+  }
+  transfer(count);
+
+  DateTime time(simRTCTime());
+  uint8_t registers[0x13];
+  memset(registers, 0, sizeof(registers));
+  registers[0] = bcd(time.second());
+  registers[1] = bcd(time.minute());
+  registers[2] = bcd(time.hour());
+  registers[3] = time.dayOfTheWeek() + 1;
+  registers[4] = bcd(time.day());
+  registers[5] = bcd(time.month());
+  registers[6] = bcd(time.year() - 2000);
+  registers[0x0F] = rtcLostPower ? 0x80 : 0x00;
+  registers[0x11] = 21;
+
+  for (uint8_t i=0; i<count && readLength < sizeof(buffer); i++) {
+    buffer[readLength++] = registers[(rtcPointer + i) % sizeof(registers)];
+  }
+  return readLength;
+}
+
+int TwoWire::read()
+{
+  return readPos < readLength ? buffer[readPos++] : -1;
+}
+
+bool RTC_DS3231::begin()
+{
+  // like RTClib the bus is started again with the default clock
+
+  Wire.begin();
+  return rtcPresent;
+}
+
+bool RTC_DS3231::lostPower()
+{
+  return rtcLostPower;
+}
+
+void RTC_DS3231::adjust(const DateTime &dt)
+{
+  simRTCSet(dt.unixtime());
+}
+
+void RTC_DS3231::writeSqwPinMode(Ds3231SqwPinMode mode)
+{
+  rtcSqw = DS3231_SquareWave1Hz == mode;
+}
+
+float RTC_DS3231::getTemperature()
+{
+  return 21.5;
+}
+
+// --------------------------------------------------------------------------
+// DateTime, days from and to the civil calendar as described by
+// Howard Hinnant, independent from the calendar of the firmware
+// --------------------------------------------------------------------------
+
+static int64_t daysFromCivil(int64_t y, unsigned m, unsigned d)
+{
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned)(y - era * 400);
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t)doe - 719468;
+}
+
+DateTime::DateTime(uint32_t t)
+{
+  int64_t z = t / DAY_SECONDS + 719468;
+  uint32_t rest = t % DAY_SECONDS;
+  int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  unsigned doe = (unsigned)(z - era * 146097);
+  unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp = (5 * doy + 2) / 153;
+  d = doy - (153 * mp + 2) / 5 + 1;
+  m = mp < 10 ? mp + 3 : mp - 9;
+  y = yoe + era * 400 + (m <= 2);
+  hh = rest / 3600;
+  mm = rest / 60 % 60;
+  ss = rest % 60;
+}
+
+DateTime::DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second)
+  : y(year < 2000 ? year + 2000 : year), m(month), d(day), hh(hour), mm(minute), ss(second)
+{
+}
+
+DateTime::DateTime(const __FlashStringHelper *date, const __FlashStringHelper *time)
+{
+  static const char MONTHS[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char name[4] = "";
+  int year = 2000, month = 1, day = 1, hour = 0, minute = 0, second = 0;
+  sscanf((const char *)date, "%3s %d %d", name, &day, &year);
+  sscanf((const char *)time, "%d:%d:%d", &hour, &minute, &second);
+  const char *found = strstr(MONTHS, name);
+  if (found && name[0]) {
+    month = (found - MONTHS) / 3 + 1;
+  }
+  *this = DateTime(year, month, day, hour, minute, second);
+}
+
+uint8_t DateTime::dayOfTheWeek() const
+{
+  return (daysFromCivil(y, m, d) % 7 + 11) % 7;
+}
+
+uint32_t DateTime::unixtime() const
+{
+  return daysFromCivil(y, m, d) * DAY_SECONDS + hh * 3600 + mm * 60 + ss;
+}
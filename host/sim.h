@@ -0,0 +1,57 @@
+// Simulation of the clock hardware for the host harness: virtual time,
+// timer 1, buttons, DS3231 with SQW output and the display buses with
+// their timing (GPIO, shift registers on SPI, port expander on I2C)
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// firmware entry points
+
+void setup();
+void loop();
+
+// wiring as in src/main.cpp
+
+const int SIM_BTN1 = 2;
+const int SIM_BTN2 = 12;
+const int SIM_RTC_PIN = 3;
+const int SIM_PWM_OUT = 5;
+
+// virtual time in microseconds since the start and millis() of the
+// firmware, which does not advance while the CPU is powered down
+
+uint64_t simTime();
+void simSetMillis(uint32_t ms);
+
+// run loop() until the given virtual time, with an optional function
+// called after each pass
+
+void simRun(uint64_t until, void (*afterLoop)() = NULL);
+
+// inputs: button levels (button 1 or 2) at a virtual time, serial data
+
+void simButton(uint64_t time, int button, int level);
+void simSerialInput(const uint8_t *data, size_t length);
+
+// DS3231: present or not, time in UTC, a second length in virtual time
+// and the seconds added per SQW period, or SQW edges given from outside,
+// the times of the last and the next falling SQW edge
+
+void simRTCPresent(bool present);
+void simRTCSet(uint32_t time);
+uint32_t simRTCTime();
+void simRTCSpeed(uint32_t secondMicros, uint32_t secondStep);
+void simRTCExternalEdge(uint64_t time);
+uint64_t simLastEdge();
+uint64_t simNextEdge();
+
+// outputs: display content, virtual time of the last character write,
+// brightness, serial output collected since the last call
+
+const char *simDisplay();
+uint64_t simLastWrite();
+int simBrightness();
+std::string simSerialOutput();
@@ -0,0 +1,293 @@
+// Time warp test of the firmware with simulated hardware
+//
+// The simulated DS3231 advances 59 seconds with every SQW period of 4 ms,
+// so a year of clock time passes in 35 minutes of virtual time and the
+// seconds take every value over time. millis() starts one minute before
+// its overflow. After every SQW period the display must show the local
+// time calculated here independently from the firmware. On every new day
+// the date is checked in the date display and the date setting, on the
+// first day of a month all days of the month are stepped through and on
+// the first day of a year all months and years, with the RTC at normal
+// speed while the buttons are pressed.
+//
+// Usage: timewarp [ZONE] [DAYS]
+//
+// ZONE is the index of the time zone in the firmware (0 UTC, 2 CET or
+// 4 EST), DAYS the number of days to run from 2035-12-31 00:00 UTC.
+// With more than 732 days the run crosses 2038-01-01, where a signed 32
+// bit unix time would overflow.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+
+#include <EEPROM.h>
+#include <RTClib.h>
+
+const uint32_t START = 2082672000UL;
+const uint32_t SQW_PERIOD = 4000;
+const uint32_t SQW_STEP = 59;
+const uint64_t PRESS_TIME = 100000;
+
+// years which can be set in the firmware
+
+const int SET_YEAR_MIN = 2021;
+const int SET_YEAR_MAX = 2099;
+
+const int STORAGE_TIME_ZONE = 4;
+
+static const char DAY_NAMES[] = "SUMOTUWETHFRSA";
+
+static int zone = 0;
+static unsigned long checks = 0;
+static unsigned long errors = 0;
+
+// --------------------------------------------------------------------------
+// Reference for the local time, EU and US DST rules
+// --------------------------------------------------------------------------
+
+static uint32_t sundayBefore(uint32_t time)
+{
+  return time - DateTime(time).dayOfTheWeek() * 86400UL;
+}
+
+static int32_t localOffset(uint32_t utc)
+{
+  int year = DateTime(utc).year();
+
+  switch (zone) {
+    case 2:
+    {
+      // last sunday of march until last sunday of october, 01:00 UTC
+      uint32_t start = sundayBefore(DateTime(year, 3, 31).unixtime()) + 3600;
+      uint32_t end = sundayBefore(DateTime(year, 10, 31).unixtime()) + 3600;
+      return utc >= start && utc < end ? 7200 : 3600;
+    }
+    case 4:
+    {
+      // second sunday of march 02:00 EST until first sunday of november
+      // 02:00 EDT
+      uint32_t start = sundayBefore(DateTime(year, 3, 14).unixtime()) + 7 * 3600;
+      uint32_t end = sundayBefore(DateTime(year, 11, 7).unixtime()) + 6 * 3600;
+      return utc >= start && utc < end ? -4 * 3600 : -5 * 3600;
+    }
+  }
+  return 0;
+}
+
+static DateTime localTime()
+{
+  uint32_t utc = simRTCTime();
+  return DateTime(utc + localOffset(utc));
+}
+
+// --------------------------------------------------------------------------
+// Helpers
+// --------------------------------------------------------------------------
+
+static void check(const char *expected, const char *context)
+{
+  checks++;
+  if (strcmp(expected, simDisplay()) != 0) {
+    errors++;
+    if (errors <= 20) {
+      DateTime now = localTime();
+      printf("%04d-%02d-%02d %02d:%02d:%02d %s: expected [%s], shown [%s]\n",
+        now.year(), now.month(), now.day(), now.hour(), now.minute(), now.second(),
+        context, expected, simDisplay());
+    }
+  }
+}
+
+// press a button, the display is checked while it is held
+
+static void press(int button, const char *expected, const char *context)
+{
+  simButton(simTime(), button, LOW);
+  simButton(simTime() + PRESS_TIME, button, HIGH);
+  simRun(simTime() + PRESS_TIME);
+
+  // settings blink, the value is shown again with the next second
+
+  uint64_t timeout = simTime() + 1000000;
+  while (strncmp(expected, simDisplay(), 3) == 0 && strcmp(expected + 3, simDisplay() + 3) != 0
+    && strspn(simDisplay() + 3, " ") == 5 && simTime() < timeout) {
+    simRun(simTime() + 1000);
+  }
+  check(expected, context);
+  simRun(simTime() + PRESS_TIME);
+}
+
+// after the date was set the local time must continue from the time
+// when the setting started, also when the DST offset of the new date
+// is different
+
+static void checkSetDate(const DateTime &start, int year, int month, int day, const char *context)
+{
+  DateTime expected(year, month, day, start.hour(), start.minute(), start.second());
+  DateTime now = localTime();
+  checks++;
+  if (now.unixtime() < expected.unixtime() || now.unixtime() > expected.unixtime() + 60) {
+    errors++;
+    if (errors <= 20) {
+      printf("%04d-%02d-%02d %02d:%02d:%02d %s: expected %04d-%02d-%02d %02d:%02d:%02d\n",
+        now.year(), now.month(), now.day(), now.hour(), now.minute(), now.second(), context,
+        expected.year(), expected.month(), expected.day(), expected.hour(), expected.minute(), expected.second());
+    }
+  }
+}
+
+static void dayName(char *name, const DateTime &date)
+{
+  name[0] = DAY_NAMES[date.dayOfTheWeek() * 2];
+  name[1] = DAY_NAMES[date.dayOfTheWeek() * 2 + 1];
+  name[2] = 0;
+}
+
+static int daysInMonth(int year, int month)
+{
+  DateTime first(year, month, 1);
+  DateTime next = 12 == month ? DateTime(year + 1, 1, 1) : DateTime(year, month + 1, 1);
+  return (next.unixtime() - first.unixtime()) / 86400;
+}
+
+// --------------------------------------------------------------------------
+// Check the date display and the date setting with the buttons
+// --------------------------------------------------------------------------
+
+static void checkDate(bool all)
+{
+  char expected[32];
+  char name[3];
+
+  // the menus are used at normal speed, afterwards the RTC continues
+  // with the time before
+
+  uint32_t time = simRTCTime();
+  simRTCSpeed(1000000, 1);
+  DateTime now = localTime();
+  int year = now.year();
+  int month = now.month();
+  int day = now.day();
+
+  dayName(name, now);
+  snprintf(expected, sizeof(expected), "%s %02d/%02d", name, day, month);
+  press(2, expected, "date display");
+
+  press(1, "DEMO    ", "menu");
+  press(1, "SET TIME", "menu");
+  press(1, "SET DATE", "menu");
+  snprintf(expected, sizeof(expected), "Y: %04d ", year);
+  press(2, expected, "year setting");
+
+  // the year must wrap from the last to the first year which can be set,
+  // after one step per year it is back at the current year
+
+  if (year < SET_YEAR_MIN || year > SET_YEAR_MAX) {
+    checks++;
+    errors++;
+    if (errors <= 20) {
+      printf("%04d-%02d-%02d year outside of %d-%d\n", year, month, day, SET_YEAR_MIN, SET_YEAR_MAX);
+    }
+  } else if (all || (1 == month && 1 == day)) {
+    int setYear = year;
+    for (int i=0; i<=SET_YEAR_MAX-SET_YEAR_MIN; i++) {
+      setYear = SET_YEAR_MAX == setYear ? SET_YEAR_MIN : setYear + 1;
+      snprintf(expected, sizeof(expected), "Y: %04d ", setYear);
+      press(1, expected, "year step");
+      checkSetDate(now, setYear, month, day, "time after year step");
+    }
+  }
+
+  snprintf(expected, sizeof(expected), "M: %02d   ", month);
+  press(2, expected, "month setting");
+
+  if (1 == day) {
+    int setMonth = month;
+    do {
+      setMonth = 12 == setMonth ? 1 : setMonth + 1;
+      snprintf(expected, sizeof(expected), "M: %02d   ", setMonth);
+      press(1, expected, "month step");
+      checkSetDate(now, year, setMonth, day, "time after month step");
+    } while (setMonth != month);
+  }
+
+  dayName(name, now);
+  snprintf(expected, sizeof(expected), "D: %02d %s", day, name);
+  press(2, expected, "day setting");
+
+  // all days of the month with their day of week, wrapping after the
+  // last day of the month
+
+  if (all || 1 == day) {
+    int setDay = day;
+    do {
+      setDay = daysInMonth(year, month) == setDay ? 1 : setDay + 1;
+      dayName(name, DateTime(year, month, setDay));
+      snprintf(expected, sizeof(expected), "D: %02d %s", setDay, name);
+      press(1, expected, "day step");
+      checkSetDate(now, year, month, setDay, "time after day step");
+    } while (setDay != day);
+  }
+
+  simButton(simTime(), 2, LOW);
+  simButton(simTime() + PRESS_TIME, 2, HIGH);
+  simRun(simTime() + 2 * PRESS_TIME);
+
+  simRTCSet(time);
+  simRTCSpeed(SQW_PERIOD, SQW_STEP);
+}
+
+// --------------------------------------------------------------------------
+// Main
+// --------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+  zone = argc > 1 ? atoi(argv[1]) : 0;
+  int days = argc > 2 ? atoi(argv[2]) : 366;
+  if (0 != zone && 2 != zone && 4 != zone) {
+    fprintf(stderr, "Usage: timewarp [ZONE] [DAYS], ZONE 0 (UTC), 2 (CET) or 4 (EST)\n");
+    return 1;
+  }
+
+  EEPROM.write(STORAGE_TIME_ZONE, zone);
+  simRTCSet(START);
+  simSetMillis(0xFFFFFFFFUL - 60000UL);
+  setup();
+  simRTCSpeed(SQW_PERIOD, SQW_STEP);
+
+  clock_t started = clock();
+  uint32_t end = START + days * 86400UL;
+  int lastDay = 0;
+  bool first = true;
+
+  while (simRTCTime() < end) {
+    // the time must be shown before the next SQW edge, a loop pass with
+    // slow display writes can end after the following edge
+
+    simRun(simNextEdge() + SQW_PERIOD * 3 / 4);
+    while (simTime() < simLastEdge() + SQW_PERIOD * 3 / 4) {
+      simRun(simLastEdge() + SQW_PERIOD * 3 / 4);
+    }
+    DateTime now = localTime();
+    char expected[16];
+    snprintf(expected, sizeof(expected), "%02d:%02d:%02d", now.hour(), now.minute(), now.second());
+    check(expected, "time display");
+
+    if (now.day() != lastDay) {
+      lastDay = now.day();
+      checkDate(first);
+      first = false;
+    }
+  }
+
+  double seconds = (double)(clock() - started) / CLOCKS_PER_SEC;
+  printf("zone %d, %d days, %.1f s, %.0f simulated seconds per second\n",
+    zone, days, seconds, (end - START) / seconds);
+  printf("checks %lu, errors %lu, millis %lu\n", checks, errors, millis());
+  return errors ? 1 : 0;
+}
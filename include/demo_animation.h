@@ -0,0 +1,14 @@
+// generated by tools/animc.py from assets/demo.anim, do not edit
+
+#pragma once
+
+const uint8_t DEMO_ANIMATION[] PROGMEM = {
+  0x04, 0x14, 0x01, 0x05, 0x08, 0x2d, 0x01, 0x05, 0x08, 0x5c, 0x01, 0x05,
+  0x08, 0x31, 0x01, 0x05, 0x08, 0x2f, 0x05, 0x03, 0x19, 0x3f, 0x21, 0x22,
+  0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e,
+  0x2f, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a,
+  0x3b, 0x3c, 0x3d, 0x3e, 0x3f, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46,
+  0x47, 0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f, 0x50, 0x51, 0x52,
+  0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x5b, 0x5c, 0x5d, 0x5e,
+  0x5f, 0x00,
+};
@@ -1,5 +1,5 @@
 /*
- * AlphaClock 1.3
+ * AlphaClock 1.4
  * 
  * Copyright 2021-2023 Arno Welzel / https://arnowelzel.de
  * 
@@ -22,9 +22,14 @@
 #include <Arduino.h>
 #include <RTClib.h>
 #include <EEPROM.h>
+#include <SPI.h>
+#include <Wire.h>
+#include <avr/sleep.h>
+
+#include "demo_animation.h"
 
 RTC_DS3231 rtc;
-bool rtcFound;
+volatile bool rtcFound;
 int operationMode;
 int menuMode;
 int modeTimeout;
@@ -43,7 +48,133 @@ unsigned long lastDebounceTime1 = 0;
 unsigned long lastDebounceTime2 = 0;
 unsigned long debounceDelay = 50;
 unsigned long blinkTimeout = 0;
-unsigned long lastSoftTimeout = 0;
+volatile unsigned long lastRTCEdge = 0;
+unsigned long lastRTCTime = 0;
+unsigned long lastRTCRead = 0;
+unsigned long lastRTCProbe = 0;
+unsigned long rtcProbeTime = 0;
+unsigned long rtcProbeTimeMax = 0;
+unsigned long rtcLosses = 0;
+unsigned long rtcReadErrors = 0;
+volatile unsigned long softClock = 0;
+volatile unsigned long softPhase = 0;
+volatile int softTrim = 0;
+
+int timeZone = 0;
+int tzOffset = 0;
+unsigned long tzYearStart = 0;
+unsigned long tzYearEnd = 0;
+unsigned long tzStart = 0;
+unsigned long tzEnd = 0;
+
+#ifdef ALPHACLOCK_TIMEWARP
+unsigned long warpChecks = 0;
+unsigned long warpErrors = 0;
+int warpDay = 0;
+#endif
+
+volatile bool secondEdge = false;
+volatile unsigned long secondEdgeMicros = 0;
+char nextTimeFrame[9];
+bool nextTimeFrameValid = false;
+unsigned long updateLatency = 0;
+unsigned long updateLatencyMax = 0;
+unsigned long bootLatency = 0;
+
+int frameState = 0;
+uint8_t frameType, frameLength, framePos, frameChecksum;
+char *frameTarget;
+bool frameAccepted;
+unsigned long lastFrameByte = 0;
+char remoteText[2][64];
+uint8_t remoteActive = 0;
+uint8_t remoteLength = 0;
+uint8_t remoteOffset = 0;
+unsigned long lastRemoteFrame = 0;
+unsigned long lastRemoteScroll = 0;
+unsigned long remoteFrames = 0;
+unsigned long remoteDrops = 0;
+
+const uint8_t *animData;
+unsigned int animPos;
+unsigned int animRepeatPos;
+uint8_t animRepeatCount;
+unsigned int animScrollText;
+uint8_t animScrollLength = 0;
+uint8_t animScrollOffset;
+uint8_t animScrollDuration;
+unsigned long animNext = 0;
+char animFrame[9];
+
+#ifdef ALPHACLOCK_TRACE
+uint8_t traceBuffer[256];
+unsigned int traceLength = 0;
+unsigned long lastTraceTime = 0;
+#ifdef ALPHACLOCK_TRACE_RTC
+unsigned long lastTraceRTC = 0;
+#endif
+#endif
+
+#ifdef ALPHACLOCK_STATS
+unsigned long lastStatsReport = 0;
+unsigned long lastStatsFrames = 0;
+#ifdef ALPHACLOCK_TIMEWARP
+unsigned long lastStatsWarpTime = 0;
+#endif
+#endif
+
+volatile unsigned long tickSeconds = 0;
+volatile uint8_t tickCentis = 0;
+bool watchRunning = false;
+unsigned long watchStart = 0;
+unsigned long watchElapsed = 0;
+unsigned long watchShown = 0;
+int countdownMinutes = 5;
+bool autoBrightness = false;
+
+uint8_t nightMode = 0;
+uint8_t nightStart = 92;
+uint8_t nightEnd = 24;
+bool nightActive = false;
+bool nightDark = false;
+volatile bool nightPowerDown = false;
+volatile bool nightSqwLevel = true;
+unsigned long lastNightButton = 0;
+bool nightWake1 = false;
+bool nightWake2 = false;
+uint8_t syncMode = 0;
+uint8_t beaconData[5];
+unsigned long beaconSecond = 0;
+bool syncPending = false;
+unsigned long syncTime = 0;
+unsigned long syncAt = 0;
+
+int localMinute = -1;
+uint8_t localDayOfWeek = 0;
+uint8_t eventIndex[64];
+uint8_t eventCount = 0;
+uint8_t eventNext = 0;
+uint8_t eventDay = 0;
+int eventMinute = -1;
+bool eventsValid = false;
+uint8_t eventData[20];
+
+#ifdef ALPHACLOCK_STATS
+unsigned long energySecond = 0;
+unsigned long energySeconds = 0;
+unsigned long energyAwakeSum = 0;
+unsigned long energyDisplaySum = 0;
+unsigned long energyDaySum = 0;
+unsigned long energyLastMicros = 0;
+#endif
+
+#ifdef LIGHT_SENSOR
+long lightFiltered = -1;
+int lightTarget = 100;
+int lightLevel = 100;
+unsigned long lastLightSample = 0;
+unsigned long lastLightFade = 0;
+#endif
 
 int setHour, setMinute, setSecond;
 bool secondChanged;
@@ -65,8 +196,183 @@ const int OP_SET_YEAR = 13;
 const int OP_SET_MONTH = 14;
 const int OP_SET_DAY = 15;
 const int OP_SET_BRIGHTNESS = 16;
+const int OP_INFO = 17;
+const int OP_REMOTE = 18;
+const int OP_MENU_STOPWATCH = 19;
+const int OP_MENU_COUNTDOWN = 20;
+const int OP_STOPWATCH = 21;
+const int OP_SET_COUNTDOWN = 22;
+const int OP_COUNTDOWN = 23;
+const int OP_MENU_SETTRIM = 24;
+const int OP_SET_TRIM = 25;
+const int OP_MENU_SETZONE = 26;
+const int OP_SET_ZONE = 27;
+const int OP_DEMO = 28;
+const int OP_MENU_SETNIGHT = 29;
+const int OP_SET_NIGHT_MODE = 30;
+const int OP_SET_NIGHT_START = 31;
+const int OP_SET_NIGHT_END = 32;
+const int OP_MENU_SETSYNC = 33;
+const int OP_SET_SYNC = 34;
 
 const int STORAGE_BRIGHTNESS = 0;
+const int STORAGE_AUTO_BRIGHTNESS = 1;
+const int STORAGE_SOFT_TRIM = 2;
+const int STORAGE_TIME_ZONE = 4;
+const int STORAGE_NIGHT_MODE = 5;
+const int STORAGE_NIGHT_START = 6;
+const int STORAGE_NIGHT_END = 7;
+const int STORAGE_SYNC_MODE = 8;
+const int STORAGE_EVENTS = 64;
+
+// RTC probing: missing SQW edge timeout, probe interval and I2C timeout
+
+const uint8_t RTC_ADDRESS = 0x68;
+const uint8_t RTC_STATUS_REGISTER = 0x0F;
+const unsigned long RTC_EDGE_TIMEOUT = 1500;
+const unsigned long RTC_PROBE_INTERVAL = 2000;
+const unsigned long RTC_WIRE_TIMEOUT = 3000;
+
+// Years which can be set, the DS3231 and the calendar functions count
+// the years until 2099
+
+const int SET_YEAR_MIN = 2021;
+const int SET_YEAR_MAX = 2099;
+
+// Night schedule: modes, times in steps of 15 minutes, dimmed brightness
+// and how long the display stays on after a button press
+
+const uint8_t NIGHT_OFF = 0;
+const uint8_t NIGHT_DIM = 1;
+const uint8_t NIGHT_BLANK = 2;
+const uint8_t NIGHT_STEPS = 96;
+const int NIGHT_DIM_BRIGHTNESS = 10;
+const unsigned long NIGHT_GRACE = 30000;
+
+// Estimated supply current of the displays at 100% and the awake MCU
+// in mA, used for the energy statistics
+
+const unsigned long DISPLAY_CURRENT = 120;
+const unsigned long MCU_CURRENT = 10;
+
+// Animation records, see tools/animc.py
+
+const uint8_t ANIM_END = 0x00;
+const uint8_t ANIM_KEY = 0x01;
+const uint8_t ANIM_DELTA = 0x02;
+const uint8_t ANIM_SCROLL = 0x03;
+const uint8_t ANIM_REPEAT = 0x04;
+const uint8_t ANIM_LOOP = 0x05;
+
+// Time warp test: start 2035-12-31 00:00:00 (monday), seconds per tick
+// and the millis() start value to get an overflow after one minute
+
+#ifdef ALPHACLOCK_TIMEWARP
+const unsigned long TIMEWARP_START = 2082672000UL;
+const int TIMEWARP_START_DAY_OF_WEEK = 1;
+const unsigned long TIMEWARP_STEP = 59;
+const unsigned long TIMEWARP_MILLIS = 0xFFFFFFFFUL - 60000UL;
+extern volatile unsigned long timer0_millis;
+#endif
+
+// Time zone rules: offsets in 15 minute steps, DST from the n-th sunday
+// (5 = last) of the start month until the n-th sunday of the end month,
+// transition times in minutes of local standard time
+
+struct TimeZoneRule
+{
+  char name[5];
+  int8_t offset;
+  int8_t dstOffset;
+  uint8_t startMonth;
+  uint8_t startWeek;
+  uint16_t startTime;
+  uint8_t endMonth;
+  uint8_t endWeek;
+  uint16_t endTime;
+};
+
+constexpr TimeZoneRule TIME_ZONES[] PROGMEM = {
+  { "UTC",    0, 0,  0, 0,   0,  0, 0,   0 },
+  { "WET",    0, 4,  3, 5,  60, 10, 5,  60 },
+  { "CET",    4, 4,  3, 5, 120, 10, 5, 120 },
+  { "EET",    8, 4,  3, 5, 180, 10, 5, 180 },
+  { "EST",  -20, 4,  3, 2, 120, 11, 1,  60 },
+  { "CST",  -24, 4,  3, 2, 120, 11, 1,  60 },
+  { "MST",  -28, 4,  3, 2, 120, 11, 1,  60 },
+  { "PST",  -32, 4,  3, 2, 120, 11, 1,  60 },
+  { "AEST",  40, 4, 10, 1, 120,  4, 1, 120 },
+};
+
+constexpr int TIME_ZONE_COUNT = sizeof(TIME_ZONES) / sizeof(TIME_ZONES[0]);
+
+// Software clock: 10 ms timer tick in ns, trim range in ppm
+
+const unsigned long SOFT_TICK_NS = 10000000UL;
+const unsigned long SOFT_SECOND_NS = 1000000000UL;
+const int SOFT_TRIM_MAX = 200;
+
+const unsigned long SERIAL_BAUDRATE = 115200;
+
+// Serial frames: STX, type, length, payload, XOR checksum of type, length
+// and payload
+
+const uint8_t FRAME_STX = 0x02;
+const uint8_t FRAME_TEXT = 'T';
+const uint8_t FRAME_TRACE_DUMP = 'D';
+const uint8_t FRAME_TRACE_DATA = 'd';
+const uint8_t FRAME_BEACON = 'B';
+const uint8_t FRAME_EVENT = 'E';
+
+const int FRAME_WAIT = 0;
+const int FRAME_TYPE = 1;
+const int FRAME_LENGTH = 2;
+const int FRAME_PAYLOAD = 3;
+const int FRAME_CHECKSUM = 4;
+
+const unsigned long FRAME_TIMEOUT = 50;
+const unsigned long REMOTE_TIMEOUT = 10000;
+const unsigned long REMOTE_SCROLL_DELAY = 250;
+
+// Time distribution: the master sends a beacon after each SQW edge,
+// followers only listen and set their clock when the offset to the
+// beacon is larger than the threshold in centiseconds
+
+const uint8_t SYNC_OFF = 0;
+const uint8_t SYNC_MASTER = 1;
+const uint8_t SYNC_FOLLOWER = 2;
+const long SYNC_THRESHOLD = 10;
+const long SYNC_MAX_SECONDS = 3600;
+
+// Events: packed records of minute of day (11 bits), text length (5 bits),
+// days of week (bit 0 = sunday) and up to 16 characters with 6 bits each,
+// events which passed while the time was not shown are shown up to
+// EVENT_LATE minutes later
+
+const uint8_t EVENT_COUNT = 64;
+const uint8_t EVENT_TEXT_LENGTH = 16;
+const int EVENT_RECORD_SIZE = 3 + EVENT_TEXT_LENGTH * 6 / 8;
+const int EVENT_UNUSED = 0x7FF;
+const int EVENT_LATE = 5;
+
+static_assert(STORAGE_EVENTS + EVENT_COUNT * EVENT_RECORD_SIZE <= 1024, "events must fit into the EEPROM");
+static_assert(sizeof(eventIndex) == EVENT_COUNT && sizeof(eventData) == 4 + EVENT_TEXT_LENGTH, "event buffers");
+
+#ifdef ALPHACLOCK_STATS
+const unsigned long STATS_INTERVAL = 10000;
+#endif
+
+// Trace events: 16 bit delta time in ms since the previous event (LSB
+// first), event type and the payload depending on the type
+
+#ifdef ALPHACLOCK_TRACE
+const uint8_t TRACE_IDLE = 0;      // no payload, 65535 ms without events
+const uint8_t TRACE_BUTTON1 = 1;   // 1 byte: new pin level
+const uint8_t TRACE_BUTTON2 = 2;   // 1 byte: new pin level
+const uint8_t TRACE_SQW = 3;       // no payload
+const uint8_t TRACE_RTC_READ = 4;  // 4 bytes: unix time read, LSB first
+const uint8_t TRACE_RTC_NEXT = 5;  // no payload, one second after the last read
+#endif
 
 // --------------------------------------------------------------------------
 // Pin mapping
@@ -97,45 +403,285 @@ const int BTN2    = 12;  // pin 18
 const int RTC_PIN = 3;   // pin 5
 const int PWM_OUT = 5;   // pin 11
 
+// Optional light sensor for automatic brightness: the DIP package has no
+// free ADC input, so this needs the TQFP package with ADC6 (pin 19).
+// Wiring: LDR from VCC to ADC6 and 10k from ADC6 to GND.
+
+#ifdef LIGHT_SENSOR
+const uint8_t LIGHT_CHANNEL = 6;
+const unsigned long LIGHT_SAMPLE_INTERVAL = 250;
+const unsigned long LIGHT_FADE_INTERVAL = 20;
+const int LIGHT_HYSTERESIS = 4;
+#endif
+
+// Pins used by the display bus backends on other board revisions:
+//
+// 74HC595 shift registers: MOSI/SCK of the hardware SPI and SR_LATCH,
+// MCP23017 port expander: I2C bus shared with the RTC module
+
+const int SR_LATCH = 10; // pin 16
+const uint8_t MCP23017_ADDRESS = 0x20;
+
+// Time the data and address lines need to settle before and during WR,
+// the DL-2416 itself only needs a few hundred nanoseconds
+
+const unsigned int DISPLAY_WRITE_DELAY = 10;
+
+// the average write time covers about the last writes of this number,
+// older ones are halved away so the sums can not overflow
+
+const unsigned long DISPLAY_COST_WINDOW = 1024;
+
 // --------------------------------------------------------------------------
-// Send a single byte to the display array
+// Display bus backend: direct GPIO wiring
 // --------------------------------------------------------------------------
 
-void sendByte(int chip, int data, int adr)
+class GpioBus
 {
-  // set data lines
-  
-  if(data & 0x01) digitalWrite(D_D0, HIGH);else digitalWrite(D_D0, LOW);
-  if(data & 0x02) digitalWrite(D_D1, HIGH);else digitalWrite(D_D1, LOW);
-  if(data & 0x04) digitalWrite(D_D2, HIGH);else digitalWrite(D_D2, LOW);
-  if(data & 0x08) digitalWrite(D_D3, HIGH);else digitalWrite(D_D3, LOW);
-  if(data & 0x10) digitalWrite(D_D4, HIGH);else digitalWrite(D_D4, LOW);
-  if(data & 0x20) digitalWrite(D_D5, HIGH);else digitalWrite(D_D5, LOW);
-  if(data & 0x40) digitalWrite(D_D6, HIGH);else digitalWrite(D_D6, LOW);
+public:
+  // the RTC alone uses the standard I2C clock
+
+  static const unsigned long WIRE_CLOCK = 100000;
+
+  static void begin()
+  {
+    pinMode(D_D0, OUTPUT);
+    pinMode(D_D1, OUTPUT);
+    pinMode(D_D2, OUTPUT);
+    pinMode(D_D3, OUTPUT);
+    pinMode(D_D4, OUTPUT);
+    pinMode(D_D5, OUTPUT);
+    pinMode(D_D6, OUTPUT);
+    pinMode(D_A0, OUTPUT);
+    pinMode(D_A1, OUTPUT);
+    pinMode(D_WR, OUTPUT);
+    pinMode(D_CE1, OUTPUT);
+    pinMode(D_CE2, OUTPUT);
+
+    digitalWrite(D_WR, HIGH);
+    digitalWrite(D_CE1, HIGH);
+    digitalWrite(D_CE2, HIGH);
+  }
 
-  // set address lines
+  static void write(int data, int adr)
+  {
+    // set data lines
 
-  if(adr & 0x01) digitalWrite(D_A0, HIGH);else digitalWrite(D_A0, LOW);
-  if(adr & 0x02) digitalWrite(D_A1, HIGH);else digitalWrite(D_A1, LOW);
+    if(data & 0x01) digitalWrite(D_D0, HIGH);else digitalWrite(D_D0, LOW);
+    if(data & 0x02) digitalWrite(D_D1, HIGH);else digitalWrite(D_D1, LOW);
+    if(data & 0x04) digitalWrite(D_D2, HIGH);else digitalWrite(D_D2, LOW);
+    if(data & 0x08) digitalWrite(D_D3, HIGH);else digitalWrite(D_D3, LOW);
+    if(data & 0x10) digitalWrite(D_D4, HIGH);else digitalWrite(D_D4, LOW);
+    if(data & 0x20) digitalWrite(D_D5, HIGH);else digitalWrite(D_D5, LOW);
+    if(data & 0x40) digitalWrite(D_D6, HIGH);else digitalWrite(D_D6, LOW);
 
-  // if adress is 0-3 use display 1, otherwise display 2
-  
-  if(adr < 4) {
-    digitalWrite(D_CE1, HIGH);
-    digitalWrite(D_CE2, LOW);
- 
-  } else {
-    digitalWrite(D_CE1, LOW);
-    digitalWrite(D_CE2, HIGH);
+    // set address lines
+
+    if(adr & 0x01) digitalWrite(D_A0, HIGH);else digitalWrite(D_A0, LOW);
+    if(adr & 0x02) digitalWrite(D_A1, HIGH);else digitalWrite(D_A1, LOW);
+
+    // if adress is 0-3 use display 1, otherwise display 2
+
+    if(adr < 4) {
+      digitalWrite(D_CE1, HIGH);
+      digitalWrite(D_CE2, LOW);
+    } else {
+      digitalWrite(D_CE1, LOW);
+      digitalWrite(D_CE2, HIGH);
+    }
+
+    // finally write output to displays
+
+    delayMicroseconds(DISPLAY_WRITE_DELAY);
+    digitalWrite(D_WR, LOW);
+    delayMicroseconds(DISPLAY_WRITE_DELAY);
+    digitalWrite(D_WR, HIGH);
   }
+};
 
-  // finally write output to displays
+// --------------------------------------------------------------------------
+// Display bus backend: two 74HC595 shift registers on the hardware SPI
+//
+// Bit 0-6: D0-D6, bit 8: A0, bit 9: A1, bit 10: CE1, bit 11: CE2, bit 12: WR
+// --------------------------------------------------------------------------
 
-  delayMicroseconds(500);
-  digitalWrite(D_WR, LOW);
-  delayMicroseconds(500);
-  digitalWrite(D_WR, HIGH);
-}
+class ShiftRegisterBus
+{
+public:
+  static const unsigned long WIRE_CLOCK = 100000;
+
+  static void begin()
+  {
+    pinMode(SR_LATCH, OUTPUT);
+    digitalWrite(SR_LATCH, HIGH);
+    SPI.begin();
+    shift(0x1C00);
+  }
+
+  static void write(int data, int adr)
+  {
+    uint16_t value = (data & 0x7F) | ((uint16_t)(adr & 0x03) << 8) | 0x1000;
+
+    // if adress is 0-3 use display 1, otherwise display 2
+
+    value |= (adr < 4) ? 0x0400 : 0x0800;
+
+    shift(value);
+    delayMicroseconds(DISPLAY_WRITE_DELAY);
+    shift(value & ~0x1000);
+    delayMicroseconds(DISPLAY_WRITE_DELAY);
+    shift(value);
+  }
+
+private:
+  static void shift(uint16_t value)
+  {
+    SPI.beginTransaction(SPISettings(8000000, MSBFIRST, SPI_MODE0));
+    digitalWrite(SR_LATCH, LOW);
+    SPI.transfer16(value);
+    digitalWrite(SR_LATCH, HIGH);
+    SPI.endTransaction();
+  }
+};
+
+// --------------------------------------------------------------------------
+// Display bus backend: MCP23017 I2C port expander
+//
+// GPA0-GPA6: D0-D6, GPB0: A0, GPB1: A1, GPB2: CE1, GPB3: CE2, GPB4: WR
+// --------------------------------------------------------------------------
+
+class PortExpanderBus
+{
+public:
+  // every character takes three I2C transfers, the MCP23017 and the
+  // DS3231 both support fast mode
+
+  static const unsigned long WIRE_CLOCK = 400000;
+
+  static void begin()
+  {
+    Wire.begin();
+    Wire.setClock(WIRE_CLOCK);
+
+    // all pins are outputs, start with both displays enabled and WR high
+
+    writeRegisters(0x00, 0x00, 0x00);
+    writeRegisters(0x12, 0x00, 0x1C);
+  }
+
+  static void write(int data, int adr)
+  {
+    uint8_t control = (adr & 0x03) | 0x10;
+
+    // if adress is 0-3 use display 1, otherwise display 2
+
+    control |= (adr < 4) ? 0x04 : 0x08;
+
+    // one transaction for data and control lines, the I2C transfers
+    // take longer than the required settle time of the displays
+
+    writeRegisters(0x12, data & 0x7F, control);
+    writeRegister(0x13, control & ~0x10);
+    writeRegister(0x13, control);
+  }
+
+private:
+  static void writeRegister(uint8_t reg, uint8_t value)
+  {
+    Wire.beginTransmission(MCP23017_ADDRESS);
+    Wire.write(reg);
+    Wire.write(value);
+    Wire.endTransmission();
+  }
+
+  static void writeRegisters(uint8_t reg, uint8_t valueA, uint8_t valueB)
+  {
+    Wire.beginTransmission(MCP23017_ADDRESS);
+    Wire.write(reg);
+    Wire.write(valueA);
+    Wire.write(valueB);
+    Wire.endTransmission();
+  }
+};
+
+// --------------------------------------------------------------------------
+// Display array using one of the bus backends
+// --------------------------------------------------------------------------
+
+template <class Bus>
+class Display
+{
+public:
+  void begin()
+  {
+    Bus::begin();
+  }
+
+  // I2C clock needed by the bus, Wire.begin() starts with 100 kHz
+
+  static unsigned long wireClock()
+  {
+    return Bus::WIRE_CLOCK;
+  }
+
+  // Send a single byte to the display array
+
+  void sendByte(int data, int adr)
+  {
+    unsigned long start = micros();
+    Bus::write(data, adr);
+    charMicros += micros() - start;
+    charWrites++;
+    if (charWrites >= DISPLAY_COST_WINDOW) {
+      charMicros /= 2;
+      charWrites /= 2;
+    }
+  }
+
+  // Send text to the display
+
+  void sendText(const char* text)
+  {
+    // limit text to 8 characters
+
+    unsigned int n=strlen(text);
+    if(n>8) n=8;
+
+    // use padded output buffer
+
+    char buf[]="        ";
+    memcpy(buf, text, n);
+
+    // only write characters which differ from the current display content
+
+    for(unsigned int i=0; i<8; i++) {
+      if (frame[i] != buf[i]) {
+        sendByte(buf[i], 7-i);
+        frame[i] = buf[i];
+      }
+    }
+  }
+
+  // Average time needed to write one character in microseconds
+
+  unsigned long charCost() const
+  {
+    return charWrites ? charMicros / charWrites : 0;
+  }
+
+private:
+  char frame[8];
+  unsigned long charMicros;
+  unsigned long charWrites;
+};
+
+#if defined(DISPLAY_BUS_SHIFT_REGISTER)
+Display<ShiftRegisterBus> display;
+#elif defined(DISPLAY_BUS_PORT_EXPANDER)
+Display<PortExpanderBus> display;
+#else
+Display<GpioBus> display;
+#endif
 
 // --------------------------------------------------------------------------
 // Send text to the display
@@ -143,16 +689,7 @@ void sendByte(int chip, int data, int adr)
 
 void sendText(const char* text)
 {
-  // limit text to 8 characters
-  
-  unsigned int n=strlen(text);
-  if(n>8) n=8;
-
-  // use padded output buffer
-  
-  char buf[]="        ";
-  strncpy(buf, text, n);
-  for(unsigned int i=0; i<8; i++) sendByte(0, buf[i], 7-i);
+  display.sendText(text);
 }
 
 // --------------------------------------------------------------------------
@@ -175,772 +712,3002 @@ void scrollText(const char* text)
 }
 
 // --------------------------------------------------------------------------
-// Display current time
+// Start an animation stored in flash
 // --------------------------------------------------------------------------
 
-void displayTime()
+void startAnimation(const uint8_t *data)
 {
-  if (!rtcFound) {
-    sendText("??:??:??");
-    return;
-  }
-  char lineout[9];
-  DateTime now = rtc.now();
-  snprintf(lineout, 9, "%02d:%02d:%02d", now.hour(), now.minute(), now.second());
-  sendText(lineout);
+  animData = data;
+  animPos = 0;
+  animRepeatCount = 0;
+  animScrollLength = 0;
+  animNext = millis();
+  memset(animFrame, ' ', 8);
+  animFrame[8] = 0;
 }
 
 // --------------------------------------------------------------------------
-// Display current day
+// Decode the next animation frame into animFrame, returns the duration
+// of the frame in ms or 0 at the end of the animation
 // --------------------------------------------------------------------------
 
-void displayDate()
+unsigned int nextAnimationFrame()
 {
-  if (!rtcFound) {
-    sendText("?? ?\?/??");
-    return;
+  // continue a running scroll record first
+
+  if (animScrollLength > 0) {
+    for (int i=0; i<8; i++) {
+      int pos = animScrollOffset + i - 8;
+      animFrame[i] = (pos >= 0 && pos < animScrollLength) ? pgm_read_byte(animData + animScrollText + pos) : ' ';
+    }
+    animScrollOffset++;
+    if (animScrollOffset > animScrollLength + 8) {
+      animScrollLength = 0;
+    }
+    return animScrollDuration * 10;
+  }
+
+  while (true) {
+    uint8_t type = pgm_read_byte(animData + animPos++);
+    switch (type) {
+      case ANIM_KEY:
+      {
+        unsigned int duration = pgm_read_byte(animData + animPos++) * 10;
+        int i = 0;
+        while (i < 8) {
+          uint8_t count = pgm_read_byte(animData + animPos++);
+          char c = pgm_read_byte(animData + animPos++);
+          while (count-- > 0 && i < 8) {
+            animFrame[i++] = c;
+          }
+        }
+        return duration;
+      }
+      case ANIM_DELTA:
+      {
+        unsigned int duration = pgm_read_byte(animData + animPos++) * 10;
+        uint8_t mask = pgm_read_byte(animData + animPos++);
+        for (int i=0; i<8; i++) {
+          if (mask & (0x80 >> i)) {
+            animFrame[i] = pgm_read_byte(animData + animPos++);
+          }
+        }
+        return duration;
+      }
+      case ANIM_SCROLL:
+        animScrollDuration = pgm_read_byte(animData + animPos++);
+        animScrollLength = pgm_read_byte(animData + animPos++);
+        animScrollText = animPos;
+        animScrollOffset = 0;
+        animPos += animScrollLength;
+        return nextAnimationFrame();
+      case ANIM_REPEAT:
+        animRepeatCount = pgm_read_byte(animData + animPos++);
+        animRepeatPos = animPos;
+        break;
+      case ANIM_LOOP:
+        if (animRepeatCount > 1) {
+          animRepeatCount--;
+          animPos = animRepeatPos;
+        }
+        break;
+      default:
+        animPos--;
+        return 0;
+    }
   }
-  char lineout[9];
-  char *dayoutput = (char *)"???";
-  DateTime now = rtc.now();
-  switch (now.dayOfTheWeek()) {
-    case 0: dayoutput = (char *)"SU";break;
-    case 1: dayoutput = (char *)"MO";break;
-    case 2: dayoutput = (char *)"TU";break;
-    case 3: dayoutput = (char *)"WE";break;
-    case 4: dayoutput = (char *)"TH";break;
-    case 5: dayoutput = (char *)"FR";break;
-    case 6: dayoutput = (char *)"SA";break;
-  }
-  snprintf(lineout, 9, "%s %02d/%02d", dayoutput, now.day(), now.month());
-  sendText(lineout);
 }
 
+#ifdef ALPHACLOCK_TRACE
 
 // --------------------------------------------------------------------------
-// Display current year
+// Record an event in the trace buffer
 // --------------------------------------------------------------------------
 
-void displayYear()
+void traceEvent(uint8_t type, const uint8_t *payload, uint8_t length)
 {
-  if (!rtcFound) {
-    sendText("  ????");
-    return;
+  // also called from interrupt handlers
+
+  uint8_t oldSREG = SREG;
+  noInterrupts();
+
+  unsigned long now = millis();
+  unsigned long delta = now - lastTraceTime;
+
+  while (delta > 0xFFFF && traceLength + 3 <= sizeof(traceBuffer)) {
+    traceBuffer[traceLength++] = 0xFF;
+    traceBuffer[traceLength++] = 0xFF;
+    traceBuffer[traceLength++] = TRACE_IDLE;
+    delta -= 0xFFFF;
   }
-  char lineout[9];
-  DateTime now = rtc.now();
-  snprintf(lineout, 9, "  %04d", now.year());
-  sendText(lineout);
+
+  // the capture stops when the buffer is full until it was dumped
+
+  if (traceLength + 3 + length <= sizeof(traceBuffer)) {
+    traceBuffer[traceLength++] = delta & 0xFF;
+    traceBuffer[traceLength++] = delta >> 8;
+    traceBuffer[traceLength++] = type;
+    for (uint8_t i=0; i<length; i++) {
+      traceBuffer[traceLength++] = payload[i];
+    }
+    lastTraceTime = now;
+  }
+
+  SREG = oldSREG;
 }
 
+#endif
+
 // --------------------------------------------------------------------------
-// Display current temperatur
+// Calendar (valid from 2000 to 2099 like the DS3231)
 // --------------------------------------------------------------------------
 
-void displayTemperature()
+struct CalendarTime
 {
-  if (!rtcFound) {
-    sendText("T: ?.?");
-    return;
-  }
-  String temperatureOutput = String(rtc.getTemperature(), 1);
-  char lineout[9];
-  snprintf(lineout, 9, "T: %s", temperatureOutput.c_str());
-  sendText(lineout);
+  int year;
+  uint8_t month;
+  uint8_t day;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+  uint8_t dayOfWeek;
+};
+
+constexpr uint8_t DAYS_IN_MONTH[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+constexpr uint16_t DAYS_BEFORE_MONTH[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+constexpr char DAY_NAMES[] = "SUMOTUWETHFRSA";
+
+// Days from 1970-01-01 to 2000-01-01 and day of week of 2000-01-01 (saturday)
+
+constexpr unsigned long DAYS_UNTIL_2000 = 10957;
+constexpr int DAY_OF_WEEK_2000 = 6;
+
+constexpr bool isLeapYear(int year)
+{
+  return (0 == year % 4 && 0 != year % 100) || 0 == year % 400;
+}
+
+constexpr int daysInMonth(int year, int month)
+{
+  return (2 == month && isLeapYear(year)) ? 29 : DAYS_IN_MONTH[month - 1];
+}
+
+constexpr unsigned long daysSince2000(int year, int month, int day)
+{
+  return (year - 2000) * 365UL + (year - 2000 + 3) / 4 + DAYS_BEFORE_MONTH[month - 1]
+    + ((month > 2 && isLeapYear(year)) ? 1 : 0) + day - 1;
+}
+
+constexpr int dayOfWeek(int year, int month, int day)
+{
+  return (daysSince2000(year, month, day) + DAY_OF_WEEK_2000) % 7;
 }
 
+static_assert(dayOfWeek(2024, 2, 29) == 4, "2024-02-29 is a thursday");
+static_assert(daysInMonth(2100, 2) == 28 && daysInMonth(2000, 2) == 29, "leap years");
+
 // --------------------------------------------------------------------------
-// RTC SQW signal interrupt handler
+// Convert calendar time to unix time
 // --------------------------------------------------------------------------
 
-void handleInterruptRTC()
+unsigned long calendarToTime(const CalendarTime &cal)
 {
-  // Reset blink timer only if no button is in repeat state
-  if (!buttonRepeat1 && !buttonRepeat2) {
-    blinkTimeout = 500;
+  return (DAYS_UNTIL_2000 + daysSince2000(cal.year, cal.month, cal.day)) * 86400UL
+    + cal.hour * 3600UL + cal.minute * 60U + cal.second;
+}
+
+// --------------------------------------------------------------------------
+// Convert unix time to calendar time
+// --------------------------------------------------------------------------
+
+void timeToCalendar(unsigned long time, CalendarTime &cal)
+{
+  unsigned long days = time / 86400UL;
+  unsigned long seconds = time - days * 86400UL;
+  cal.hour = seconds / 3600;
+  cal.minute = (seconds / 60) % 60;
+  cal.second = seconds % 60;
+
+  days -= DAYS_UNTIL_2000;
+  cal.dayOfWeek = (days + DAY_OF_WEEK_2000) % 7;
+
+  // every 4 years start with a leap year until 2099
+
+  unsigned int cycle = days / 1461;
+  unsigned int rest = days % 1461;
+  cal.year = 2000 + cycle * 4;
+  if (rest >= 366) {
+    rest -= 366;
+    cal.year += 1 + rest / 365;
+    rest %= 365;
   }
 
-  // Trigger display update
-  doDisplayUpdate = true;
+  cal.month = 1;
+  while (rest >= (unsigned int)daysInMonth(cal.year, cal.month)) {
+    rest -= daysInMonth(cal.year, cal.month);
+    cal.month++;
+  }
+  cal.day = rest + 1;
 }
 
 // --------------------------------------------------------------------------
-// Setup
+// Get two letter name of a day of week (0 = sunday)
 // --------------------------------------------------------------------------
 
-void setup() {
-  // initialize I/O
-  
-  pinMode(D_D0, OUTPUT);
-  pinMode(D_D1, OUTPUT);
-  pinMode(D_D2, OUTPUT);
-  pinMode(D_D3, OUTPUT);
-  pinMode(D_D4, OUTPUT);
-  pinMode(D_D5, OUTPUT);
-  pinMode(D_D6, OUTPUT);
-  pinMode(D_A0, OUTPUT);
-  pinMode(D_A1, OUTPUT);
-  pinMode(D_WR, OUTPUT);
-  pinMode(D_CE1, OUTPUT);
-  pinMode(D_CE2, OUTPUT);
-  pinMode(BTN1, INPUT_PULLUP);
-  pinMode(BTN2, INPUT_PULLUP);
-  pinMode(PWM_OUT, OUTPUT);
+void dayName(char *name, int dayOfWeek)
+{
+  name[0] = DAY_NAMES[dayOfWeek * 2];
+  name[1] = DAY_NAMES[dayOfWeek * 2 + 1];
+  name[2] = 0;
+}
 
-  digitalWrite(D_WR, HIGH);
-  digitalWrite(D_CE1, HIGH);
-  digitalWrite(D_CE2, HIGH);
-  analogWrite(PWM_OUT, 255);
+// --------------------------------------------------------------------------
+// Read the time registers of the RTC as unix time
+// --------------------------------------------------------------------------
 
-  // initialize global stuff
+uint8_t bcdToBin(uint8_t value)
+{
+  return value - 6 * (value >> 4);
+}
 
-  operationMode = OP_TIME;
-  modeTimeout = 0;
-  modeTarget = OP_TIME;
-  rtcFound = false;
-  doDisplayUpdate = false;
-  displayBrightness = 100;
-  buttonState1 = HIGH;
-  buttonState2 = HIGH;
-  lastButtonState1 = HIGH;
-  lastButtonState2 = HIGH;
-  buttonHandled1 = false;
-  buttonHandled2 = false;
+bool readRTCTime(unsigned long &time)
+{
+  uint8_t data[7];
 
-  // restore settings
+  Wire.beginTransmission(RTC_ADDRESS);
+  Wire.write((uint8_t)0);
+  Wire.endTransmission();
+  if (Wire.requestFrom(RTC_ADDRESS, (uint8_t)7) != 7) {
+    return false;
+  }
+  for (int i=0; i<7; i++) {
+    data[i] = Wire.read();
+  }
 
-  displayBrightness = EEPROM.read(STORAGE_BRIGHTNESS);
-  if (displayBrightness < 10) {
-    displayBrightness = 10;
-    EEPROM.write(STORAGE_BRIGHTNESS, displayBrightness);
-  } else if (displayBrightness > 100) {
-    displayBrightness = 100;
-    EEPROM.write(STORAGE_BRIGHTNESS, displayBrightness);
+  CalendarTime cal;
+  cal.second = bcdToBin(data[0] & 0x7F);
+  cal.minute = bcdToBin(data[1]);
+  cal.hour = bcdToBin(data[2] & 0x3F);
+  cal.day = bcdToBin(data[4]);
+  cal.month = bcdToBin(data[5] & 0x1F);
+  cal.year = 2000 + bcdToBin(data[6]);
+
+  // values read from a failing bus must not break the calculation
+
+  if (cal.second > 59 || cal.minute > 59 || cal.hour > 23
+    || cal.month < 1 || cal.month > 12 || cal.year > 2099
+    || cal.day < 1 || cal.day > daysInMonth(cal.year, cal.month)) {
+    return false;
   }
+  time = calendarToTime(cal);
+  return true;
+}
 
-  // initialize RTC module
-  
-  if (rtc.begin()) {
-    rtcFound = true;
+// --------------------------------------------------------------------------
+// Read current time (UTC) from the RTC or the software clock
+// --------------------------------------------------------------------------
 
-    // if RTC lost its power (battery empty/missing) set time
-    // to modification time of this file
-    
-    if (rtc.lostPower()) {
-      rtc.adjust(DateTime(F(__DATE__), F(__TIME__)));
-    }
+unsigned long readClock()
+{
+  if (rtcFound) {
+    // keep the last time read, so the software clock can continue
+    // from there if the RTC gets lost
 
-    // setup interrupt for time display update
-    
-    pinMode(RTC_PIN, INPUT_PULLUP);
-    attachInterrupt(digitalPinToInterrupt(RTC_PIN), handleInterruptRTC, FALLING);
+    // after a failed read the time continues from the last valid one
 
-    // tell the RTC to output a 1 Hz signal for the interrupt trigger
-    
-    rtc.writeSqwPinMode(DS3231_SquareWave1Hz);
+    unsigned long time;
+    if (!readRTCTime(time)) {
+      rtcReadErrors++;
+      return lastRTCTime + (millis() - lastRTCRead) / 1000;
+    }
+    lastRTCTime = time;
+    lastRTCRead = millis();
+#if defined(ALPHACLOCK_TRACE) && defined(ALPHACLOCK_TRACE_RTC)
+    // repeated reads of the same second are left out and the next second
+    // is recorded without payload, so the buffer lasts longer
+
+    if (0 != lastTraceRTC && lastTraceRTC + 1 == lastRTCTime) {
+      traceEvent(TRACE_RTC_NEXT, NULL, 0);
+    } else if (lastTraceRTC != lastRTCTime) {
+      uint8_t payload[4] = {
+        (uint8_t)lastRTCTime, (uint8_t)(lastRTCTime >> 8),
+        (uint8_t)(lastRTCTime >> 16), (uint8_t)(lastRTCTime >> 24)
+      };
+      traceEvent(TRACE_RTC_READ, payload, 4);
+    }
+    lastTraceRTC = lastRTCTime;
+#endif
+    return lastRTCTime;
   }
 
-  // display welcome message
-  
-  sendText("V 1.3");
-  delay(1000);
-  if (!rtcFound) {
-    sendText("NO RTC");
-    delay(1000);
-  } else {
-    sendText("RTC OK");
-    delay(1000);
+  noInterrupts();
+  unsigned long now = softClock;
+  interrupts();
+  return now;
+}
+
+// --------------------------------------------------------------------------
+// Set current time (UTC) of the RTC or the software clock
+// --------------------------------------------------------------------------
+
+void adjustClock(unsigned long time)
+{
+  if (rtcFound) {
+    rtc.adjust(DateTime(time));
+    return;
   }
 
-  lastSoftTimeout = millis();
+  // like the RTC restart the second when the time is set
 
-  // restore configured brightness
-  analogWrite(PWM_OUT, displayBrightness * 255 / 100);
+  noInterrupts();
+  softClock = time;
+  softPhase = 0;
+  tickCentis = 0;
+  interrupts();
 }
 
 // --------------------------------------------------------------------------
-// Debounced button reading
+// Get the time zone rule from flash
 // --------------------------------------------------------------------------
 
-void readButtonDebounced(int num)
+TimeZoneRule readTimeZone(int zone)
 {
-  int port, *lastButtonState, *buttonState;
-  bool *buttonHandled, *buttonRepeat;
-  long unsigned int *lastDebounceTime;
-  
-  // Set references depending on which button we want to read
+  TimeZoneRule rule;
+  memcpy_P(&rule, &TIME_ZONES[zone], sizeof(rule));
+  return rule;
+}
 
-  if (1 == num) {
-    port = BTN1;
-    lastButtonState = &lastButtonState1;
-    lastDebounceTime = &lastDebounceTime1;
-    buttonState = &buttonState1;
-    buttonHandled = &buttonHandled1;
-    buttonRepeat = &buttonRepeat1;
-  } else {
-    port = BTN2;
-    lastButtonState = &lastButtonState2;
-    lastDebounceTime = &lastDebounceTime2;
-    buttonState = &buttonState2;
-    buttonHandled = &buttonHandled2;
-    buttonRepeat = &buttonRepeat2;
-  }
-  
-  // Read current button state
+// --------------------------------------------------------------------------
+// Get the day of the n-th sunday of a month (5 = last)
+// --------------------------------------------------------------------------
+
+int nthSunday(int year, int month, int week)
+{
+  int day = 1 + (7 - dayOfWeek(year, month, 1)) % 7 + (week - 1) * 7;
+  while (day > daysInMonth(year, month)) {
+    day -= 7;
+  }
+  return day;
+}
+
+// --------------------------------------------------------------------------
+// Calculate the DST transitions of a year in UTC
+// --------------------------------------------------------------------------
+
+void updateTransitions(int year)
+{
+  TimeZoneRule rule = readTimeZone(timeZone);
+
+  tzYearStart = (DAYS_UNTIL_2000 + daysSince2000(year, 1, 1)) * 86400UL;
+  tzYearEnd = (DAYS_UNTIL_2000 + daysSince2000(year + 1, 1, 1)) * 86400UL;
+  if (0 == rule.dstOffset) {
+    tzStart = 0;
+    tzEnd = 0;
+    return;
+  }
+
+  long offset = rule.offset * 900L;
+  tzStart = (DAYS_UNTIL_2000 + daysSince2000(year, rule.startMonth, nthSunday(year, rule.startMonth, rule.startWeek))) * 86400UL
+    + rule.startTime * 60L - offset;
+  tzEnd = (DAYS_UNTIL_2000 + daysSince2000(year, rule.endMonth, nthSunday(year, rule.endMonth, rule.endWeek))) * 86400UL
+    + rule.endTime * 60L - offset;
+}
+
+// --------------------------------------------------------------------------
+// Check if DST is in effect at the given time (UTC), the transitions must
+// be calculated for its year
+// --------------------------------------------------------------------------
+
+bool isDST(unsigned long time)
+{
+  if (tzStart < tzEnd) {
+    return time >= tzStart && time < tzEnd;
+  }
+  if (tzStart > tzEnd) {
+    // southern hemisphere, DST over the turn of the year
+    return time >= tzStart || time < tzEnd;
+  }
+  return false;
+}
+
+// --------------------------------------------------------------------------
+// Read current local time, the RTC is kept in UTC
+// --------------------------------------------------------------------------
+
+void readLocalTime(CalendarTime &local)
+{
+  unsigned long now = readClock();
+
+  // the transitions are calculated once per year, so the time
+  // only needs a compare and an add
+
+  if (now < tzYearStart || now >= tzYearEnd) {
+    CalendarTime utc;
+    timeToCalendar(now, utc);
+    updateTransitions(utc.year);
+  }
+
+  TimeZoneRule rule = readTimeZone(timeZone);
+  tzOffset = rule.offset;
+  if (isDST(now)) {
+    tzOffset += rule.dstOffset;
+  }
+
+  timeToCalendar(now + tzOffset * 900L, local);
+}
+
+// --------------------------------------------------------------------------
+// Set current time from local time with the offset in effect at that time
+// --------------------------------------------------------------------------
+
+void adjustLocalTime(const CalendarTime &local)
+{
+  // the offset of the time to set is used, not the current one, so
+  // setting a date across a DST change keeps the hour
+
+  TimeZoneRule rule = readTimeZone(timeZone);
+  unsigned long time = calendarToTime(local) - rule.offset * 900L;
+
+  if (time < tzYearStart || time >= tzYearEnd) {
+    CalendarTime utc;
+    timeToCalendar(time, utc);
+    updateTransitions(utc.year);
+  }
+
+  // a local time which exists twice when DST ends is taken as DST, a
+  // local time skipped when DST starts as standard time
+
+  tzOffset = rule.offset;
+  if (0 != rule.dstOffset && isDST(time - rule.dstOffset * 900L)) {
+    tzOffset += rule.dstOffset;
+    time -= rule.dstOffset * 900L;
+  }
+  adjustClock(time);
+}
+
+// --------------------------------------------------------------------------
+// Render time as HH:MM:SS
+// --------------------------------------------------------------------------
+
+void renderTime(char *lineout, int hour, int minute, int second)
+{
+  // digits written directly, cheaper than snprintf() and always 8
+  // characters
+
+  lineout[0] = '0' + hour / 10;
+  lineout[1] = '0' + hour % 10;
+  lineout[2] = ':';
+  lineout[3] = '0' + minute / 10;
+  lineout[4] = '0' + minute % 10;
+  lineout[5] = ':';
+  lineout[6] = '0' + second / 10;
+  lineout[7] = '0' + second % 10;
+  lineout[8] = 0;
+}
+
+// --------------------------------------------------------------------------
+// Render the frame for the following second in advance
+// --------------------------------------------------------------------------
+
+void prerenderNextTime(int hour, int minute, int second)
+{
+  second++;
+  if (second > 59) {
+    second = 0;
+    minute++;
+    if (minute > 59) {
+      minute = 0;
+      hour++;
+      if (hour > 23) {
+        hour = 0;
+      }
+    }
+  }
+  renderTime(nextTimeFrame, hour, minute, second);
+  nextTimeFrameValid = true;
+}
+
+// --------------------------------------------------------------------------
+// Record latency between the last second edge and the visible update
+// --------------------------------------------------------------------------
+
+void recordUpdateLatency()
+{
+  noInterrupts();
+  unsigned long edgeMicros = secondEdgeMicros;
+  interrupts();
+
+  updateLatency = micros() - edgeMicros;
+  if (updateLatency > updateLatencyMax) {
+    updateLatencyMax = updateLatency;
+  }
+}
+
+// --------------------------------------------------------------------------
+// Next year when setting the date
+// --------------------------------------------------------------------------
+
+int nextYear(int year)
+{
+  year++;
+  if (year > SET_YEAR_MAX) {
+    year = SET_YEAR_MIN;
+  }
+  return year;
+}
+
+// --------------------------------------------------------------------------
+// Next day of the month when setting the date
+// --------------------------------------------------------------------------
+
+int nextDay(int day, int month, int year)
+{
+  day++;
+  if (day > daysInMonth(year, month)) {
+    day = 1;
+  }
+  return day;
+}
+
+#ifdef ALPHACLOCK_TIMEWARP
+
+// --------------------------------------------------------------------------
+// Check display and date setting behaviour while the time is warped
+// --------------------------------------------------------------------------
+
+void checkTimewarp(const CalendarTime &local)
+{
+  // RTClib is used as independent reference for the calendar
+
+  DateTime now(calendarToTime(local));
+  if (now.year() != local.year || now.month() != local.month || now.day() != local.day
+    || now.hour() != local.hour || now.dayOfTheWeek() != local.dayOfWeek) {
+    warpErrors++;
+  }
+
+  // the frame prepared for the next second must match the clock
+
+  char expected[9];
+  DateTime later(now.unixtime() + 1);
+  renderTime(expected, later.hour(), later.minute(), later.second());
+  if (strcmp(expected, nextTimeFrame) != 0) {
+    warpErrors++;
+  }
+
+  // the day of week is checked whenever the day changed, the date
+  // setting is covered by the host simulation (env:timewarp)
+
+  if (local.day == warpDay) {
+    return;
+  }
+
+  // the clock advances with every tick, so the check waits for the next
+  // second if it changed while the local time was read
+
+  unsigned long utc = readClock();
+  CalendarTime current;
+  readLocalTime(current);
+  if (readClock() != utc) {
+    return;
+  }
+  warpDay = current.day;
+  warpChecks++;
+
+  // the day of week must follow the days since the start, counted from
+  // the day before so zones west of UTC stay positive on the first day
+
+  unsigned long days = (utc + tzOffset * 900L - (TIMEWARP_START - 86400UL)) / 86400UL;
+  if ((TIMEWARP_START_DAY_OF_WEEK + 6 + days) % 7 != (unsigned long)current.dayOfWeek) {
+    warpErrors++;
+  }
+}
+
+#endif
+
+// --------------------------------------------------------------------------
+// Check if the given local time (minutes) is inside the night schedule
+// --------------------------------------------------------------------------
+
+bool isNightTime(int minutes)
+{
+  int start = nightStart * 15;
+  int end = nightEnd * 15;
+
+  if (NIGHT_OFF == nightMode || start == end) {
+    return false;
+  }
+  if (start < end) {
+    return minutes >= start && minutes < end;
+  }
+  return minutes >= start || minutes < end;
+}
+
+// --------------------------------------------------------------------------
+// Display current time
+// --------------------------------------------------------------------------
+
+void displayTime()
+{
+  // on a second edge show the frame rendered in advance first, only the
+  // changed characters are written, the RTC is read afterwards to verify it
+
+  bool edge = secondEdge;
+  secondEdge = false;
+  if (edge && nextTimeFrameValid) {
+    sendText(nextTimeFrame);
+    recordUpdateLatency();
+  }
+
+  char lineout[9];
+  CalendarTime now;
+  readLocalTime(now);
+  renderTime(lineout, now.hour, now.minute, now.second);
+  sendText(lineout);
+  if (0 == bootLatency) {
+    bootLatency = micros();
+  }
+  if (edge && !nextTimeFrameValid) {
+    recordUpdateLatency();
+  }
+
+  // use the idle rest of this second to prepare the next frame
+
+  prerenderNextTime(now.hour, now.minute, now.second);
+  localMinute = now.hour * 60 + now.minute;
+  localDayOfWeek = now.dayOfWeek;
+  nightActive = isNightTime(localMinute);
+
+#ifdef ALPHACLOCK_TIMEWARP
+  checkTimewarp(now);
+#endif
+}
+
+// --------------------------------------------------------------------------
+// Display current day
+// --------------------------------------------------------------------------
+
+void displayDate()
+{
+  char lineout[9];
+  char dayoutput[3];
+  CalendarTime now;
+  readLocalTime(now);
+  dayName(dayoutput, now.dayOfWeek);
+
+  // the limits let the compiler see that the text fits
+
+  int day = min(now.day, (uint8_t)31);
+  int month = min(now.month, (uint8_t)12);
+  snprintf(lineout, sizeof(lineout), "%s %02d/%02d", dayoutput, day, month);
+  sendText(lineout);
+}
+
+
+// --------------------------------------------------------------------------
+// Display current year
+// --------------------------------------------------------------------------
+
+void displayYear()
+{
+  char lineout[9];
+  CalendarTime now;
+  readLocalTime(now);
+  snprintf(lineout, 9, "  %04d", now.year);
+  sendText(lineout);
+}
+
+// --------------------------------------------------------------------------
+// Display current temperatur
+// --------------------------------------------------------------------------
+
+void displayTemperature()
+{
+  if (!rtcFound) {
+    sendText("T: ?.?");
+    return;
+  }
+  String temperatureOutput = String(rtc.getTemperature(), 1);
+  char lineout[9];
+  snprintf(lineout, 9, "T: %s", temperatureOutput.c_str());
+  sendText(lineout);
+}
+
+// --------------------------------------------------------------------------
+// Start of a new second from the RTC or the software clock
+// --------------------------------------------------------------------------
+
+void handleSecondTick()
+{
+  // Reset blink timer only if no button is in repeat state
+  if (!buttonRepeat1 && !buttonRepeat2) {
+    blinkTimeout = 500;
+  }
+
+  // Start the next second of the centisecond tick
+  tickSeconds++;
+  tickCentis = 0;
+
+  // Remember the edge for the prerendered frame and latency measurement
+  secondEdge = true;
+  secondEdgeMicros = micros();
+
+  // Trigger display update
+  doDisplayUpdate = true;
+}
+
+// --------------------------------------------------------------------------
+// Timer 1 interrupt handler (100 Hz tick)
+// --------------------------------------------------------------------------
+
+ISR(TIMER1_COMPA_vect)
+{
+  // With RTC the second is started by the SQW signal, so the centiseconds
+  // stop at 99 if the timer runs faster than the RTC and can not drift
+
+  if (tickCentis < 99) {
+    tickCentis++;
+  }
+
+  // Without RTC the software clock accumulates the trimmed tick length,
+  // the remainder is kept for the next second, so there is no drift
+  // besides the crystal error which is corrected by the trim value
+
+#ifdef ALPHACLOCK_TIMEWARP
+  softClock += TIMEWARP_STEP;
+  handleSecondTick();
+#else
+  if (!rtcFound) {
+    softPhase += SOFT_TICK_NS + softTrim * (long)(SOFT_TICK_NS / 1000000UL);
+    if (softPhase >= SOFT_SECOND_NS) {
+      softPhase -= SOFT_SECOND_NS;
+      softClock++;
+      handleSecondTick();
+    }
+  }
+#endif
+}
+
+// --------------------------------------------------------------------------
+// Read the centisecond tick counter
+// --------------------------------------------------------------------------
+
+unsigned long readTickCentis()
+{
+  noInterrupts();
+  unsigned long centis = tickSeconds * 100 + tickCentis;
+  interrupts();
+  return centis;
+}
+
+// --------------------------------------------------------------------------
+// RTC SQW signal interrupt handler
+// --------------------------------------------------------------------------
+
+void handleInterruptRTC()
+{
+#ifdef ALPHACLOCK_TRACE
+  traceEvent(TRACE_SQW, NULL, 0);
+#endif
+  lastRTCEdge = millis();
+  handleSecondTick();
+}
+
+// --------------------------------------------------------------------------
+// Pin change interrupt handlers, only used to wake up from power down
+// --------------------------------------------------------------------------
+
+ISR(PCINT2_vect)
+{
+  // INT1 needs the I/O clock to detect an edge, so during power down
+  // the falling SQW edge is taken from the pin change of port D which
+  // also wakes up on button 1
+
+  bool level = digitalRead(RTC_PIN);
+  if (nightPowerDown && nightSqwLevel && !level) {
+    handleInterruptRTC();
+  }
+  nightSqwLevel = level;
+}
+
+EMPTY_INTERRUPT(PCINT0_vect);
+
+// --------------------------------------------------------------------------
+// Initialize RTC module, returns false if not found
+// --------------------------------------------------------------------------
+
+bool startRTC(unsigned long fallback)
+{
+  // rtc.begin() starts the bus again with the default clock
+
+  bool found = rtc.begin();
+  Wire.setClock(display.wireClock());
+  if (!found) {
+    return false;
+  }
+
+  // if RTC lost its power (battery empty/missing) set time
+  // to the given fallback
+
+  if (rtc.lostPower()) {
+    rtc.adjust(DateTime(fallback));
+  }
+
+  // setup interrupt for time display update
+
+  lastRTCEdge = millis();
+  pinMode(RTC_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(RTC_PIN), handleInterruptRTC, FALLING);
+
+  // tell the RTC to output a 1 Hz signal for the interrupt trigger
+
+  rtc.writeSqwPinMode(DS3231_SquareWave1Hz);
+  return true;
+}
+
+// --------------------------------------------------------------------------
+// Check if the RTC responds with a single byte status read
+// --------------------------------------------------------------------------
+
+bool probeRTC()
+{
+  Wire.beginTransmission(RTC_ADDRESS);
+  Wire.write(RTC_STATUS_REGISTER);
+  if (Wire.endTransmission() != 0) {
+    return false;
+  }
+  if (Wire.requestFrom(RTC_ADDRESS, (uint8_t)1) != 1) {
+    return false;
+  }
+  Wire.read();
+  return true;
+}
+
+// --------------------------------------------------------------------------
+// Start the I2C bus with the clock of the display bus, transfers use a
+// timeout so a locked bus can not hang the clock
+// --------------------------------------------------------------------------
+
+void beginI2C()
+{
+  Wire.begin();
+  Wire.setClock(display.wireClock());
+#ifdef WIRE_HAS_TIMEOUT
+  Wire.setWireTimeout(RTC_WIRE_TIMEOUT, true);
+#endif
+}
+
+// --------------------------------------------------------------------------
+// Free a locked I2C bus with 9 clocks on SCL and a STOP condition
+// --------------------------------------------------------------------------
+
+void recoverI2C()
+{
+  Wire.end();
+
+  // a slave holding SDA low gets clocked until it has sent its byte
+
+  pinMode(SDA, INPUT_PULLUP);
+  digitalWrite(SCL, HIGH);
+  pinMode(SCL, OUTPUT);
+  for (int i=0; i<9; i++) {
+    delayMicroseconds(5);
+    digitalWrite(SCL, LOW);
+    delayMicroseconds(5);
+    digitalWrite(SCL, HIGH);
+  }
+
+  // STOP condition: SDA goes high while SCL is high
+
+  digitalWrite(SDA, LOW);
+  pinMode(SDA, OUTPUT);
+  delayMicroseconds(5);
+  pinMode(SDA, INPUT_PULLUP);
+  delayMicroseconds(5);
+  pinMode(SCL, INPUT_PULLUP);
+
+  beginI2C();
+}
+
+// --------------------------------------------------------------------------
+// Detect loss and return of the RTC module
+// --------------------------------------------------------------------------
+
+void checkRTC()
+{
+#ifdef ALPHACLOCK_TIMEWARP
+  return;
+#endif
+
+  // a missing SQW edge or an I2C timeout makes the RTC suspect, without
+  // RTC it is probed periodically in case it was connected again
+
+  noInterrupts();
+  unsigned long lastEdge = lastRTCEdge;
+  interrupts();
+
+  bool suspect = !rtcFound || millis() - lastEdge > RTC_EDGE_TIMEOUT;
+#ifdef WIRE_HAS_TIMEOUT
+  suspect = suspect || Wire.getWireTimeoutFlag();
+#endif
+  if (!suspect || millis() - lastRTCProbe < RTC_PROBE_INTERVAL) {
+    return;
+  }
+  lastRTCProbe = millis();
+
+  unsigned long start = micros();
+#ifdef WIRE_HAS_TIMEOUT
+  Wire.clearWireTimeoutFlag();
+#endif
+
+  if (rtcFound && !probeRTC()) {
+    // RTC lost, continue with the software clock from the last time read
+
+    detachInterrupt(digitalPinToInterrupt(RTC_PIN));
+    unsigned long now = lastRTCTime + (millis() - lastRTCRead) / 1000;
+    rtcFound = false;
+    adjustClock(now);
+    rtcLosses++;
+    recoverI2C();
+  } else if (!rtcFound && probeRTC()) {
+    // RTC is back, keep the software clock time if it lost its power
+
+    unsigned long now = readClock();
+    if (startRTC(now)) {
+      rtcFound = true;
+    }
+  } else if (rtcFound) {
+    // RTC responds but there is no SQW signal, e.g. after it was
+    // reconnected, so initialize it again
+
+    startRTC(readClock());
+  }
+
+  rtcProbeTime = micros() - start;
+  if (rtcProbeTime > rtcProbeTimeMax) {
+    rtcProbeTimeMax = rtcProbeTime;
+  }
+}
+
+// --------------------------------------------------------------------------
+// Setup
+// --------------------------------------------------------------------------
+
+void setup() {
+  // initialize I/O
+  
+  display.begin();
+  pinMode(BTN1, INPUT_PULLUP);
+  pinMode(BTN2, INPUT_PULLUP);
+  pinMode(PWM_OUT, OUTPUT);
+
+  // initialize global stuff
+
+  operationMode = OP_TIME;
+  modeTimeout = 0;
+  modeTarget = OP_TIME;
+  rtcFound = false;
+  doDisplayUpdate = false;
+  displayBrightness = 100;
+  buttonState1 = HIGH;
+  buttonState2 = HIGH;
+  lastButtonState1 = HIGH;
+  lastButtonState2 = HIGH;
+  buttonHandled1 = false;
+  buttonHandled2 = false;
+
+  // restore settings before anything is shown, so the display
+  // starts with the configured brightness
+
+  displayBrightness = EEPROM.read(STORAGE_BRIGHTNESS);
+  unsigned int trim;
+  EEPROM.get(STORAGE_SOFT_TRIM, trim);
+  if (trim <= 2 * SOFT_TRIM_MAX) {
+    softTrim = (int)trim - SOFT_TRIM_MAX;
+  }
+
+  timeZone = EEPROM.read(STORAGE_TIME_ZONE);
+  if (timeZone >= TIME_ZONE_COUNT) {
+    timeZone = 0;
+  }
+  tzOffset = readTimeZone(timeZone).offset;
+
+  syncMode = EEPROM.read(STORAGE_SYNC_MODE);
+  if (syncMode > SYNC_FOLLOWER) {
+    syncMode = SYNC_OFF;
+  }
+
+  nightMode = EEPROM.read(STORAGE_NIGHT_MODE);
+  if (nightMode > NIGHT_BLANK) {
+    nightMode = NIGHT_OFF;
+  }
+  nightStart = EEPROM.read(STORAGE_NIGHT_START);
+  nightEnd = EEPROM.read(STORAGE_NIGHT_END);
+  if (nightStart >= NIGHT_STEPS || nightEnd >= NIGHT_STEPS) {
+    nightStart = 92;
+    nightEnd = 24;
+  }
+
+  if (displayBrightness < 10) {
+    displayBrightness = 10;
+    EEPROM.write(STORAGE_BRIGHTNESS, displayBrightness);
+  } else if (displayBrightness > 100) {
+    displayBrightness = 100;
+    EEPROM.write(STORAGE_BRIGHTNESS, displayBrightness);
+  }
+#ifdef LIGHT_SENSOR
+  autoBrightness = (1 == EEPROM.read(STORAGE_AUTO_BRIGHTNESS));
+  lightLevel = displayBrightness;
+  lightTarget = displayBrightness;
+#endif
+  analogWrite(PWM_OUT, displayBrightness * 255 / 100);
+
+  // initialize RTC module, if RTC lost its power set time to
+  // modification time of this file (converted to UTC with the standard
+  // time offset)
+
+#ifdef ALPHACLOCK_TIMEWARP
+  unsigned long buildTime = TIMEWARP_START;
+#else
+  unsigned long buildTime = DateTime(F(__DATE__), F(__TIME__)).unixtime() - tzOffset * 900L;
+#endif
+
+  beginI2C();
+#ifdef ALPHACLOCK_TIMEWARP
+  // the software clock simulates the RTC, the real RTC is not touched
+
+  rtcFound = false;
+  noInterrupts();
+  timer0_millis = TIMEWARP_MILLIS;
+  interrupts();
+#else
+  rtcFound = startRTC(buildTime);
+#endif
+
+  Serial.begin(SERIAL_BAUDRATE);
+#ifdef ALPHACLOCK_STATS
+  lastStatsReport = millis();
+#endif
+
+  // setup timer 1 for a 100 Hz tick (16 MHz / 64 / 2500)
+
+  noInterrupts();
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS11) | _BV(CS10);
+  OCR1A = 2499;
+  TIMSK1 = _BV(OCIE1A);
+  interrupts();
+
+  // without RTC start the software clock with the modification time
+  // of this file
+
+  if (!rtcFound) {
+    adjustClock(buildTime);
+  }
+#if defined(ALPHACLOCK_TIMEWARP) && defined(ALPHACLOCK_STATS)
+  lastStatsWarpTime = TIMEWARP_START;
+#endif
+
+  // show version and RTC status without blocking when button 2 is held
+  // during power up or no RTC was found, otherwise show the time at once
+
+  if (!rtcFound || LOW == digitalRead(BTN2)) {
+    if (LOW == digitalRead(BTN2)) {
+      buttonState2 = LOW;
+      lastButtonState2 = LOW;
+      buttonHandled2 = true;
+    }
+    operationMode = OP_INFO;
+    modeTimeout = 2000;
+    modeTarget = OP_TIME;
+    doDisplayUpdate = true;
+  } else {
+    displayTime();
+  }
+}
+
+// --------------------------------------------------------------------------
+// Debounced button reading
+// --------------------------------------------------------------------------
+
+void readButtonDebounced(int num)
+{
+  int port, *lastButtonState, *buttonState;
+  bool *buttonHandled, *buttonRepeat;
+  long unsigned int *lastDebounceTime;
+  
+  // Set references depending on which button we want to read
+
+  if (1 == num) {
+    port = BTN1;
+    lastButtonState = &lastButtonState1;
+    lastDebounceTime = &lastDebounceTime1;
+    buttonState = &buttonState1;
+    buttonHandled = &buttonHandled1;
+    buttonRepeat = &buttonRepeat1;
+  } else {
+    port = BTN2;
+    lastButtonState = &lastButtonState2;
+    lastDebounceTime = &lastDebounceTime2;
+    buttonState = &buttonState2;
+    buttonHandled = &buttonHandled2;
+    buttonRepeat = &buttonRepeat2;
+  }
+  
+  // Read current button state
+  
+  int reading = digitalRead(port);
+
+  if (reading != *lastButtonState) {
+    // State changed, then record current time as last change time
+    
+    *lastDebounceTime = millis();
+    *lastButtonState = reading;
+
+#ifdef ALPHACLOCK_TRACE
+    uint8_t level = reading;
+    traceEvent(1 == num ? TRACE_BUTTON1 : TRACE_BUTTON2, &level, 1);
+#endif
+  }
+
+  if ((millis() - *lastDebounceTime) > debounceDelay) {
+
+    // If last change time is older than the desired debounce delay,
+    // and button state changed, then keep this state as current button state
+    // and reset flags for "handled" and "repeat active"
+    
+    if (reading != *buttonState)
+    {
+      *buttonState = reading;
+      *buttonHandled = false;
+      *buttonRepeat = false;
+    } else {
+
+      // If state did not change, check if button is already in repeat mode
+
+      if (*buttonState == LOW && millis() - lastDebounceTime1 > 2000) {
+        *buttonRepeat = true;
+      }
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+// Handle display update with function call
+// --------------------------------------------------------------------------
+
+void handleDisplayUpdateFunction(void (*displayFunc)(void))
+{
+  if (doDisplayUpdate) {
+    doDisplayUpdate = false;
+    displayFunc();
+  }
+}
+
+// --------------------------------------------------------------------------
+// Handle display update with text
+// --------------------------------------------------------------------------
+
+void handleDisplayUpdateText(const char *text)
+{
+  if (doDisplayUpdate) {
+    doDisplayUpdate = false;
+    sendText(text);
+  }
+}
+
+// --------------------------------------------------------------------------
+// Set button handled flag and new operation mode
+// --------------------------------------------------------------------------
+
+void setButtonHandled(int num, int newOperationMode, int newModeTimeout, int newModeTarget)
+{
+  bool *buttonHandled;
+
+  if (1 == num) {
+    buttonHandled = &buttonHandled1;
+  } else {
+    buttonHandled = &buttonHandled2;
+  }
+
+  *buttonHandled = true;
+  operationMode = newOperationMode;
+  doDisplayUpdate = true;
+  modeTimeout = newModeTimeout;
+  modeTarget = newModeTarget;
+}
+
+// --------------------------------------------------------------------------
+// Set date of RTC with current set values
+// --------------------------------------------------------------------------
+
+void setRTCDate()
+{
+  CalendarTime now;
+  readLocalTime(now);
+  now.year = setYear;
+  now.month = setMonth;
+  now.day = setDay;
+  adjustLocalTime(now);
+}
+
+
+// --------------------------------------------------------------------------
+// Set time of RTC with current set values
+// --------------------------------------------------------------------------
+
+void setRTCTime()
+{
+  CalendarTime now;
+  readLocalTime(now);
+  now.hour = setHour;
+  now.minute = setMinute;
+  now.second = setSecond;
+  adjustLocalTime(now);
+}
+
+// --------------------------------------------------------------------------
+// Loop in time mode
+// --------------------------------------------------------------------------
+
+void loopTime()
+{
+  handleDisplayUpdateFunction(displayTime);
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_DEMO, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    setButtonHandled(2, OP_DATE, 5000, OP_TIME);
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop in date mode
+// --------------------------------------------------------------------------
+
+void loopDate()
+{
+  handleDisplayUpdateFunction(displayDate);
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_DEMO, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    setButtonHandled(2, OP_YEAR, 5000, OP_TIME);
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop in year mode
+// --------------------------------------------------------------------------
+
+void loopYear()
+{
+  handleDisplayUpdateFunction(displayYear);
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_DEMO, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    setButtonHandled(2, OP_TEMPERATURE, 5000, OP_TIME);
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop in temp mode
+// --------------------------------------------------------------------------
+
+void loopTemperature()
+{
+  handleDisplayUpdateFunction(displayTemperature);
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_DEMO, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    setButtonHandled(2, OP_TIME, 0, OP_TIME);
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop in info mode (version and RTC status)
+// --------------------------------------------------------------------------
+
+void loopInfo()
+{
+  // show the version first and the RTC status for the last second
+
+  if (modeTimeout > 1000) {
+    sendText("V 1.4");
+  } else if (rtcFound) {
+    sendText("RTC OK");
+  } else {
+    sendText("NO RTC");
+  }
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_TIME, 0, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    setButtonHandled(2, OP_TIME, 0, OP_TIME);
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for menu - "demo"
+// --------------------------------------------------------------------------
+
+void loopMenuDemo()
+{
+  handleDisplayUpdateText("DEMO");
   
-  int reading = digitalRead(port);
+  if (LOW == buttonState1 && !buttonHandled1) {
+
+    setButtonHandled(1, OP_MENU_SETTIME, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    operationMode = OP_DEMO;
+    modeTimeout = 0;
+    startAnimation(DEMO_ANIMATION);
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop in demo mode
+// --------------------------------------------------------------------------
+
+void loopDemo()
+{
+  // frames are decoded from flash when they are due, so the
+  // buttons are still handled while the demo is running
+
+  if ((long)(millis() - animNext) >= 0) {
+    unsigned int duration = nextAnimationFrame();
+    if (0 == duration) {
+      operationMode = OP_MENU_DEMO;
+      doDisplayUpdate = true;
+      modeTimeout = 10000;
+      modeTarget = OP_TIME;
+      return;
+    }
+    sendText(animFrame);
+    animNext += duration;
+  }
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_DEMO, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    setButtonHandled(2, OP_MENU_DEMO, 10000, OP_TIME);
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for menu - "set time"
+// --------------------------------------------------------------------------
+
+void loopMenuSetTime()
+{
+  handleDisplayUpdateText("SET TIME");
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_SETDATE, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    operationMode = OP_SET_HOUR;
+    modeTimeout = 0;
+    secondChanged = false;
+    doDisplayUpdate = true;
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for menu - "set date"
+// --------------------------------------------------------------------------
+
+void loopMenuSetDate()
+{
+  handleDisplayUpdateText("SET DATE");
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_SETZONE, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    operationMode = OP_SET_YEAR;
+    modeTimeout = 0;
+    doDisplayUpdate = true;
+
+    // the date is read once, the set values are kept while editing
+
+    CalendarTime now;
+    readLocalTime(now);
+    setYear = now.year;
+    setMonth = now.month;
+    setDay = now.day;
+
+    // a year the clock can not be set to starts at the nearest one
+
+    if (setYear < SET_YEAR_MIN) {
+      setYear = SET_YEAR_MIN;
+    } else if (setYear > SET_YEAR_MAX) {
+      setYear = SET_YEAR_MAX;
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for menu - "set time zone"
+// --------------------------------------------------------------------------
+
+void loopMenuSetZone()
+{
+  handleDisplayUpdateText("ZONE");
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_SETBRIGHTNESS, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    operationMode = OP_SET_ZONE;
+    modeTimeout = 0;
+    doDisplayUpdate = true;
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for menu - "set brightness"
+// --------------------------------------------------------------------------
+
+void loopMenuSetBrightness()
+{
+  handleDisplayUpdateText("LIGHT");
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_SETNIGHT, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    operationMode = OP_SET_BRIGHTNESS;
+    modeTimeout = 0;
+    doDisplayUpdate = true;
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for menu - "night schedule"
+// --------------------------------------------------------------------------
+
+void loopMenuSetNight()
+{
+  handleDisplayUpdateText("NIGHT");
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_STOPWATCH, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    operationMode = OP_SET_NIGHT_MODE;
+    modeTimeout = 0;
+    doDisplayUpdate = true;
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for menu - "stopwatch"
+// --------------------------------------------------------------------------
+
+void loopMenuStopwatch()
+{
+  handleDisplayUpdateText("WATCH");
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_COUNTDOWN, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    setButtonHandled(2, OP_STOPWATCH, 0, OP_TIME);
+    watchRunning = false;
+    watchElapsed = 0;
+    watchShown = 1;
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for menu - "countdown"
+// --------------------------------------------------------------------------
+
+void loopMenuCountdown()
+{
+  handleDisplayUpdateText("TIMER");
+
+  // the trim setting is only used by the software clock
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, rtcFound ? OP_MENU_SETSYNC : OP_MENU_SETTRIM, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    setButtonHandled(2, OP_SET_COUNTDOWN, 0, OP_TIME);
+    blinkTimeout = 500;
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for menu - "set trim"
+// --------------------------------------------------------------------------
+
+void loopMenuSetTrim()
+{
+  handleDisplayUpdateText("TRIM");
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_SETSYNC, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    operationMode = OP_SET_TRIM;
+    modeTimeout = 0;
+    doDisplayUpdate = true;
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for menu - "time distribution"
+// --------------------------------------------------------------------------
+
+void loopMenuSetSync()
+{
+  handleDisplayUpdateText("SYNC");
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_EXIT, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    operationMode = OP_SET_SYNC;
+    modeTimeout = 0;
+    doDisplayUpdate = true;
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for menu - "exit"
+// --------------------------------------------------------------------------
+
+void loopMenuExit()
+{
+  handleDisplayUpdateText("EXIT");
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_MENU_DEMO, 10000, OP_TIME);
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    setButtonHandled(2, OP_TIME, 0, OP_TIME);
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for time setting
+// --------------------------------------------------------------------------
+
+void loopSetTime()
+{
+  if (doDisplayUpdate) {
+    doDisplayUpdate = false;
+
+    if (!secondChanged) {
+      CalendarTime now;
+      readLocalTime(now);
+      setHour = now.hour;
+      setMinute = now.minute;
+      setSecond = now.second;
+    }
+
+    char lineout[9];
+
+    snprintf(lineout, 9, "%02d:%02d:%02d", setHour, setMinute, setSecond);
+
+    if(0 == blinkTimeout) {
+      int pos = 0;
+      if (OP_SET_MINUTE == operationMode) {
+        pos = 3;
+      } else if (OP_SET_SECOND == operationMode) {
+        pos = 6;
+      }
+      lineout[pos] = ' ';
+      lineout[pos+1] = ' ';
+    }
+
+    sendText(lineout);
+  }
+
+  if (LOW == buttonState1) {
+    if (!buttonHandled1 || buttonRepeat1) {
+      buttonHandled1 = true;
+      switch (operationMode) {
+        case OP_SET_HOUR:
+          setHour++;
+          if (setHour > 23) {
+            setHour = 0;
+          }
+          setRTCTime();
+          break;
+        case OP_SET_MINUTE:
+          setMinute++;
+          if (setMinute > 59) {
+            setMinute = 0;
+          }
+          setRTCTime();
+          break;
+        case OP_SET_SECOND:
+          secondChanged = true;
+          setSecond++;
+          if (setSecond > 59) {
+            setSecond = 0;
+          }
+          setRTCTime();
+          break;
+      }
+      doDisplayUpdate = true;
+      blinkTimeout = 500;
+
+      if (buttonRepeat1) {
+        delay(100);
+      }
+    }
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    switch (operationMode) {
+      case OP_SET_HOUR:
+        operationMode = OP_SET_MINUTE;
+        doDisplayUpdate = true;
+        blinkTimeout = 500;
+        break;
+      case OP_SET_MINUTE:
+        operationMode = OP_SET_SECOND;
+        doDisplayUpdate = true;
+        blinkTimeout = 500;
+        break;
+      case OP_SET_SECOND:
+        operationMode = OP_TIME;
+        doDisplayUpdate = true;
+        blinkTimeout = 500;
+        if (secondChanged) {
+          setRTCTime();
+        }
+        break;
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for date setting
+// --------------------------------------------------------------------------
+
+void loopSetDate()
+{
+  if (doDisplayUpdate) {
+    doDisplayUpdate = false;
+
+    char lineout[9];
+    char dayoutput[3];
+
+    switch (operationMode) {
+      case OP_SET_YEAR:
+        snprintf(lineout, 9, "Y: %04d", setYear);
+        break;
+      case OP_SET_MONTH:
+        snprintf(lineout, 9, "M: %02d", setMonth);
+        break;
+      case OP_SET_DAY:
+        dayName(dayoutput, dayOfWeek(setYear, setMonth, setDay));
+        snprintf(lineout, 9, "D: %02d %s", setDay, dayoutput);
+        break;
+    }
+    if (0 == blinkTimeout) {
+      lineout[3] = 0;
+    }
+
+    sendText(lineout);
+  }
+
+  if (LOW == buttonState1) {
+    if (!buttonHandled1 || buttonRepeat1) {
+      buttonHandled1 = true;
+      switch (operationMode) {
+        case OP_SET_YEAR:
+          setYear = nextYear(setYear);
+          if (setDay > daysInMonth(setYear, setMonth)) {
+            setDay = daysInMonth(setYear, setMonth);
+          }
+          setRTCDate();
+          break;
+        case OP_SET_MONTH:
+          setMonth++;
+          if (setMonth > 12) {
+            setMonth = 1;
+          }
+          if (setDay > daysInMonth(setYear, setMonth)) {
+            setDay = daysInMonth(setYear, setMonth);
+          }
+          setRTCDate();
+          break;
+        case OP_SET_DAY:
+          setDay = nextDay(setDay, setMonth, setYear);
+          setRTCDate();
+          break;
+      }
+      doDisplayUpdate = true;
+      blinkTimeout = 500;
+
+      if (buttonRepeat1) {
+        delay(100);
+      }
+    }
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    switch (operationMode) {
+      case OP_SET_YEAR:
+        operationMode = OP_SET_MONTH;
+        doDisplayUpdate = true;
+        blinkTimeout = 500;
+        break;
+      case OP_SET_MONTH:
+        operationMode = OP_SET_DAY;
+        doDisplayUpdate = true;
+        blinkTimeout = 500;
+        break;
+      case OP_SET_DAY:
+        operationMode = OP_TIME;
+        doDisplayUpdate = true;
+        blinkTimeout = 500;
+        break;
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for night schedule setting
+// --------------------------------------------------------------------------
+
+void loopSetNight()
+{
+  if (doDisplayUpdate) {
+    doDisplayUpdate = false;
+
+    char lineout[9];
+
+    switch (operationMode) {
+      case OP_SET_NIGHT_MODE:
+        if (NIGHT_DIM == nightMode) {
+          strcpy(lineout, "N: DIM");
+        } else if (NIGHT_BLANK == nightMode) {
+          strcpy(lineout, "N: BLANK");
+        } else {
+          strcpy(lineout, "N: OFF");
+        }
+        break;
+      case OP_SET_NIGHT_START:
+        snprintf(lineout, 9, "S: %02d:%02d", nightStart / 4, nightStart % 4 * 15);
+        break;
+      case OP_SET_NIGHT_END:
+        snprintf(lineout, 9, "E: %02d:%02d", nightEnd / 4, nightEnd % 4 * 15);
+        break;
+    }
+
+    if (0 == blinkTimeout) {
+      lineout[3] = 0;
+    }
+
+    sendText(lineout);
+  }
+
+  if (LOW == buttonState1) {
+    if (!buttonHandled1 || buttonRepeat1) {
+      buttonHandled1 = true;
+      switch (operationMode) {
+        case OP_SET_NIGHT_MODE:
+          nightMode++;
+          if (nightMode > NIGHT_BLANK) {
+            nightMode = NIGHT_OFF;
+          }
+          break;
+        case OP_SET_NIGHT_START:
+          nightStart++;
+          if (nightStart >= NIGHT_STEPS) {
+            nightStart = 0;
+          }
+          break;
+        case OP_SET_NIGHT_END:
+          nightEnd++;
+          if (nightEnd >= NIGHT_STEPS) {
+            nightEnd = 0;
+          }
+          break;
+      }
+      doDisplayUpdate = true;
+      blinkTimeout = 500;
+
+      if (buttonRepeat1) {
+        delay(100);
+      }
+    }
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    doDisplayUpdate = true;
+    blinkTimeout = 500;
+
+    if (OP_SET_NIGHT_MODE == operationMode && NIGHT_OFF != nightMode) {
+      operationMode = OP_SET_NIGHT_START;
+    } else if (OP_SET_NIGHT_START == operationMode) {
+      operationMode = OP_SET_NIGHT_END;
+    } else {
+      operationMode = OP_TIME;
+
+      // the schedule is checked again with the next time display
+
+      nightActive = false;
+      EEPROM.write(STORAGE_NIGHT_MODE, nightMode);
+      EEPROM.write(STORAGE_NIGHT_START, nightStart);
+      EEPROM.write(STORAGE_NIGHT_END, nightEnd);
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for brightness setting
+// --------------------------------------------------------------------------
+
+void loopSetBrightness()
+{
+  if (doDisplayUpdate) {
+    doDisplayUpdate = false;
+    
+    char lineout[9];
+
+    if (autoBrightness) {
+      strcpy(lineout, "L: AUTO");
+    } else {
+      snprintf(lineout, 9, "L: %03d%%", displayBrightness);
+    }
+
+    if(0 == blinkTimeout) {
+      lineout[3] = 0;
+    }
+
+    sendText(lineout);
+  }
+
+  if (LOW == buttonState1) {
+    if (!buttonHandled1 || buttonRepeat1) {
+      buttonHandled1 = true;
+
+      // with a light sensor "AUTO" follows 100%
+
+      if (autoBrightness) {
+        autoBrightness = false;
+        displayBrightness = 10;
+      } else {
+        displayBrightness += 5;
+        if (displayBrightness > 100) {
+#ifdef LIGHT_SENSOR
+          autoBrightness = true;
+          displayBrightness = 100;
+#else
+          displayBrightness = 10;
+#endif
+        }
+      }
+      if (!autoBrightness) {
+        analogWrite(PWM_OUT, displayBrightness * 255 / 100);
+      }
+#ifdef LIGHT_SENSOR
+      lightLevel = displayBrightness;
+#endif
+      doDisplayUpdate = true;
+      blinkTimeout = 500;
+
+      if (buttonRepeat1) {
+        delay(100);
+      }
+    }
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    operationMode = OP_TIME;
+    doDisplayUpdate = true;
+    blinkTimeout = 500;
+
+    EEPROM.write(STORAGE_BRIGHTNESS, displayBrightness);
+#ifdef LIGHT_SENSOR
+    EEPROM.write(STORAGE_AUTO_BRIGHTNESS, autoBrightness ? 1 : 0);
+#endif
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for time distribution setting
+// --------------------------------------------------------------------------
+
+void loopSetSync()
+{
+  if (doDisplayUpdate) {
+    doDisplayUpdate = false;
+
+    char lineout[9];
+
+    if (SYNC_MASTER == syncMode) {
+      strcpy(lineout, "S: SEND");
+    } else if (SYNC_FOLLOWER == syncMode) {
+      strcpy(lineout, "S: RECV");
+    } else {
+      strcpy(lineout, "S: OFF");
+    }
+
+    if (0 == blinkTimeout) {
+      lineout[3] = 0;
+    }
+
+    sendText(lineout);
+  }
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    buttonHandled1 = true;
+    syncMode++;
+    if (syncMode > SYNC_FOLLOWER) {
+      syncMode = SYNC_OFF;
+    }
+    syncPending = false;
+    doDisplayUpdate = true;
+    blinkTimeout = 500;
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    operationMode = OP_TIME;
+    doDisplayUpdate = true;
+    blinkTimeout = 500;
+
+    EEPROM.write(STORAGE_SYNC_MODE, syncMode);
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for time zone setting
+// --------------------------------------------------------------------------
+
+void loopSetZone()
+{
+  if (doDisplayUpdate) {
+    doDisplayUpdate = false;
+
+    char lineout[9];
+
+    snprintf(lineout, 9, "Z: %s", readTimeZone(timeZone).name);
+
+    if(0 == blinkTimeout) {
+      lineout[3] = 0;
+    }
+
+    sendText(lineout);
+  }
+
+  if (LOW == buttonState1) {
+    if (!buttonHandled1 || buttonRepeat1) {
+      buttonHandled1 = true;
+      timeZone++;
+      if (timeZone >= TIME_ZONE_COUNT) {
+        timeZone = 0;
+      }
+
+      // transitions of the new zone are calculated with the next read
+
+      tzYearEnd = 0;
+      doDisplayUpdate = true;
+      blinkTimeout = 500;
+
+      if (buttonRepeat1) {
+        delay(100);
+      }
+    }
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    operationMode = OP_TIME;
+    doDisplayUpdate = true;
+    blinkTimeout = 500;
+
+    EEPROM.write(STORAGE_TIME_ZONE, timeZone);
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for software clock trim setting
+// --------------------------------------------------------------------------
+
+void loopSetTrim()
+{
+  if (doDisplayUpdate) {
+    doDisplayUpdate = false;
+
+    char lineout[9];
+
+    snprintf(lineout, 9, "T: %+04d", softTrim);
+
+    if(0 == blinkTimeout) {
+      lineout[3] = 0;
+    }
+
+    sendText(lineout);
+  }
+
+  if (LOW == buttonState1) {
+    if (!buttonHandled1 || buttonRepeat1) {
+      buttonHandled1 = true;
+      int trim = softTrim + 1;
+      if (trim > SOFT_TRIM_MAX) {
+        trim = -SOFT_TRIM_MAX;
+      }
+      noInterrupts();
+      softTrim = trim;
+      interrupts();
+      doDisplayUpdate = true;
+      blinkTimeout = 500;
+
+      if (buttonRepeat1) {
+        delay(100);
+      }
+    }
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    operationMode = OP_TIME;
+    doDisplayUpdate = true;
+    blinkTimeout = 500;
+
+    unsigned int trim = softTrim + SOFT_TRIM_MAX;
+    EEPROM.put(STORAGE_SOFT_TRIM, trim);
+  }
+}
+
+// --------------------------------------------------------------------------
+// Render centiseconds as MM:SS.cc
+// --------------------------------------------------------------------------
+
+void renderWatch(char *lineout, unsigned long centis)
+{
+  unsigned long seconds = centis / 100;
+  snprintf(lineout, 9, "%02d:%02d.%02d", (int)(seconds / 60 % 100), (int)(seconds % 60), (int)(centis % 100));
+}
+
+// --------------------------------------------------------------------------
+// Get elapsed centiseconds of the stopwatch
+// --------------------------------------------------------------------------
+
+unsigned long watchCentis()
+{
+  if (watchRunning) {
+    return watchElapsed + readTickCentis() - watchStart;
+  }
+  return watchElapsed;
+}
+
+// --------------------------------------------------------------------------
+// Start or stop the stopwatch
+// --------------------------------------------------------------------------
+
+void toggleWatch()
+{
+  if (watchRunning) {
+    watchElapsed = watchCentis();
+    watchRunning = false;
+  } else {
+    watchStart = readTickCentis();
+    watchRunning = true;
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for stopwatch
+// --------------------------------------------------------------------------
+
+void loopStopwatch()
+{
+  // only render when the value changed, the display itself is only
+  // written for the changed digits
+
+  unsigned long centis = watchCentis();
+  if (centis != watchShown || doDisplayUpdate) {
+    doDisplayUpdate = false;
+    watchShown = centis;
+
+    char lineout[9];
+    renderWatch(lineout, centis);
+    sendText(lineout);
+  }
+
+  if (LOW == buttonState1 && !buttonHandled1) {
+    buttonHandled1 = true;
+
+    // reset a stopped stopwatch first, exit when already reset
+
+    if (!watchRunning) {
+      if (watchElapsed > 0) {
+        watchElapsed = 0;
+      } else {
+        operationMode = OP_TIME;
+        doDisplayUpdate = true;
+      }
+    }
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    toggleWatch();
+  }
+}
+
+// --------------------------------------------------------------------------
+// Loop for countdown setting
+// --------------------------------------------------------------------------
+
+void loopSetCountdown()
+{
+  if (doDisplayUpdate) {
+    doDisplayUpdate = false;
+
+    char lineout[9];
+
+    snprintf(lineout, 9, "%02d:00.00", countdownMinutes);
+
+    if(0 == blinkTimeout) {
+      lineout[0] = ' ';
+      lineout[1] = ' ';
+    }
+
+    sendText(lineout);
+  }
+
+  if (LOW == buttonState1) {
+    if (!buttonHandled1 || buttonRepeat1) {
+      buttonHandled1 = true;
+      countdownMinutes++;
+      if (countdownMinutes > 99) {
+        countdownMinutes = 1;
+      }
+      doDisplayUpdate = true;
+      blinkTimeout = 500;
 
-  if (reading != *lastButtonState) {
-    // State changed, then record current time as last change time
-    
-    *lastDebounceTime = millis();
-    *lastButtonState = reading;
+      if (buttonRepeat1) {
+        delay(100);
+      }
+    }
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    operationMode = OP_COUNTDOWN;
+    watchRunning = false;
+    watchElapsed = 0;
+    watchShown = 1;
+    doDisplayUpdate = true;
+    toggleWatch();
   }
+}
 
-  if ((millis() - *lastDebounceTime) > debounceDelay) {
+// --------------------------------------------------------------------------
+// Loop for countdown
+// --------------------------------------------------------------------------
 
-    // If last change time is older than the desired debounce delay,
-    // and button state changed, then keep this state as current button state
-    // and reset flags for "handled" and "repeat active"
-    
-    if (reading != *buttonState)
-    {
-      *buttonState = reading;
-      *buttonHandled = false;
-      *buttonRepeat = false;
+void loopCountdown()
+{
+  unsigned long total = (unsigned long)countdownMinutes * 6000;
+  unsigned long centis = watchCentis();
+
+  if (centis >= total) {
+    // finished, stop and blink zero
+
+    if (watchRunning) {
+      watchRunning = false;
+      watchElapsed = total;
+    }
+    if (0 == blinkTimeout) {
+      sendText("");
     } else {
+      sendText("00:00.00");
+    }
+  } else if (total - centis != watchShown || doDisplayUpdate) {
+    doDisplayUpdate = false;
+    watchShown = total - centis;
 
-      // If state did not change, check if button is already in repeat mode
+    char lineout[9];
+    renderWatch(lineout, watchShown);
+    sendText(lineout);
+  }
 
-      if (*buttonState == LOW && millis() - lastDebounceTime1 > 2000) {
-        *buttonRepeat = true;
-      }
+  if (LOW == buttonState1 && !buttonHandled1) {
+    setButtonHandled(1, OP_TIME, 0, OP_TIME);
+    watchRunning = false;
+  } else if (LOW == buttonState2 && !buttonHandled2) {
+    buttonHandled2 = true;
+    if (watchElapsed < total) {
+      toggleWatch();
+    } else {
+      operationMode = OP_TIME;
+      doDisplayUpdate = true;
     }
   }
 }
 
+#ifdef LIGHT_SENSOR
+
 // --------------------------------------------------------------------------
-// Handle display update with function call
+// ADC conversion complete interrupt, only used to wake up from sleep
 // --------------------------------------------------------------------------
 
-void handleDisplayUpdateFunction(void (*displayFunc)(void))
+EMPTY_INTERRUPT(ADC_vect);
+
+// --------------------------------------------------------------------------
+// Read the light sensor with the CPU sleeping during the conversion
+// --------------------------------------------------------------------------
+
+int readLightSensor()
 {
-  if (doDisplayUpdate) {
-    doDisplayUpdate = false;
-    displayFunc();
+  // AVCC as reference, the prescaler was already set by the Arduino core
+
+  ADMUX = _BV(REFS0) | LIGHT_CHANNEL;
+  ADCSRA |= _BV(ADIE);
+
+  // ADC noise reduction also stops the I/O clock and with it the UART
+  // and timer 1, so only use idle sleep while serial data may arrive or
+  // the software clock is running
+
+  if (!rtcFound || OP_REMOTE == operationMode || FRAME_WAIT != frameState) {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    ADCSRA |= _BV(ADSC);
+  } else {
+    set_sleep_mode(SLEEP_MODE_ADC);
+  }
+
+  // entering sleep starts the conversion, other interrupts may
+  // wake up the CPU before it is complete
+
+  sleep_enable();
+  do {
+    sleep_cpu();
+  } while (ADCSRA & _BV(ADSC));
+  sleep_disable();
+
+  ADCSRA &= ~_BV(ADIE);
+  return ADC;
+}
+
+// --------------------------------------------------------------------------
+// Adjust brightness to the ambient light
+// --------------------------------------------------------------------------
+
+void updateAutoBrightness()
+{
+  if (millis() - lastLightSample >= LIGHT_SAMPLE_INTERVAL) {
+    lastLightSample = millis();
+
+    // exponential moving average with alpha 1/8 in 1/16 steps
+
+    long sample = (long)readLightSensor() * 16;
+    if (lightFiltered < 0) {
+      lightFiltered = sample;
+    } else {
+      lightFiltered += (sample - lightFiltered) / 8;
+    }
+
+    // only change the target when the difference is larger than the
+    // hysteresis, so the brightness does not flicker on the threshold
+
+    int brightness = 10 + lightFiltered * 90 / (1023L * 16);
+    if (abs(brightness - lightTarget) > LIGHT_HYSTERESIS) {
+      lightTarget = brightness;
+    }
+  }
+
+  // fade to the target brightness in steps of 1%
+
+  if (lightLevel != lightTarget && millis() - lastLightFade >= LIGHT_FADE_INTERVAL) {
+    lastLightFade = millis();
+    lightLevel += (lightLevel < lightTarget) ? 1 : -1;
+    analogWrite(PWM_OUT, lightLevel * 255 / 100);
   }
 }
 
+#endif
+
 // --------------------------------------------------------------------------
-// Handle display update with text
+// Get the brightness in percent without the night schedule
 // --------------------------------------------------------------------------
 
-void handleDisplayUpdateText(const char *text)
+int dayBrightness()
 {
-  if (doDisplayUpdate) {
-    doDisplayUpdate = false;
-    sendText(text);
+#ifdef LIGHT_SENSOR
+  if (autoBrightness) {
+    return lightLevel;
   }
+#endif
+  return displayBrightness;
 }
 
 // --------------------------------------------------------------------------
-// Set button handled flag and new operation mode
+// Get the brightness in percent the display should have now
 // --------------------------------------------------------------------------
 
-void setButtonHandled(int num, int newOperationMode, int newModeTimeout, int newModeTarget)
+int currentBrightness()
 {
-  bool *buttonHandled;
+  int brightness = dayBrightness();
+  if (nightDark) {
+    if (NIGHT_BLANK == nightMode) {
+      brightness = 0;
+    } else if (brightness > NIGHT_DIM_BRIGHTNESS) {
+      brightness = NIGHT_DIM_BRIGHTNESS;
+    }
+  }
+  return brightness;
+}
 
-  if (1 == num) {
-    buttonHandled = &buttonHandled1;
-  } else {
-    buttonHandled = &buttonHandled2;
+// --------------------------------------------------------------------------
+// Dim or blank the display during the night schedule
+// --------------------------------------------------------------------------
+
+void updateNight()
+{
+  // the raw button level is used, so the display is back at once
+  // and not only after the debounce delay
+
+  if (LOW == lastButtonState1 || LOW == lastButtonState2) {
+    lastNightButton = millis();
   }
 
-  *buttonHandled = true;
-  operationMode = newOperationMode;
-  doDisplayUpdate = true;
-  modeTimeout = newModeTimeout;
-  modeTarget = newModeTarget;
+  // a press which wakes up the display is only used for that, so it is
+  // marked as handled once it passed the debounce, a bounce which never
+  // did is forgotten when the button is released again
+
+  if (nightDark) {
+    nightWake1 = nightWake1 || LOW == lastButtonState1;
+    nightWake2 = nightWake2 || LOW == lastButtonState2;
+  }
+  if (nightWake1 && LOW == buttonState1) {
+    buttonHandled1 = true;
+    nightWake1 = false;
+  } else if (HIGH == lastButtonState1 && millis() - lastDebounceTime1 > debounceDelay) {
+    nightWake1 = false;
+  }
+  if (nightWake2 && LOW == buttonState2) {
+    buttonHandled2 = true;
+    nightWake2 = false;
+  } else if (HIGH == lastButtonState2 && millis() - lastDebounceTime2 > debounceDelay) {
+    nightWake2 = false;
+  }
+
+  bool dark = nightActive && OP_TIME == operationMode && millis() - lastNightButton > NIGHT_GRACE;
+  if (dark != nightDark) {
+    nightDark = dark;
+    analogWrite(PWM_OUT, currentBrightness() * 255 / 100);
+  }
 }
 
 // --------------------------------------------------------------------------
-// Set date of RTC with current set values
+// Sleep until the next interrupt while the display is dark
 // --------------------------------------------------------------------------
 
-void setRTCDate()
+void sleepNight()
 {
-  if (!rtcFound) {
+  // power down stops all timers and the UART, so it is only possible
+  // with the blanked display, the RTC as time base and no frame being
+  // received, otherwise idle sleep until the next timer 0 tick
+
+  if (NIGHT_BLANK != nightMode || !rtcFound || FRAME_WAIT != frameState) {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sleep_cpu();
+    sleep_disable();
     return;
   }
 
-  DateTime now = rtc.now();
-  rtc.adjust(DateTime(setYear, setMonth, setDay, now.hour(), now.minute(), now.second()));
+  Serial.flush();
+
+  // wake up on pin changes of both buttons and SQW, the SQW edge is
+  // handled by the pin change interrupt until the CPU is awake again
+
+  noInterrupts();
+  *digitalPinToPCMSK(BTN1) |= _BV(digitalPinToPCMSKbit(BTN1));
+  *digitalPinToPCMSK(BTN2) |= _BV(digitalPinToPCMSKbit(BTN2));
+  *digitalPinToPCMSK(RTC_PIN) |= _BV(digitalPinToPCMSKbit(RTC_PIN));
+  PCIFR = _BV(digitalPinToPCICRbit(BTN2)) | _BV(digitalPinToPCICRbit(RTC_PIN));
+  *digitalPinToPCICR(BTN2) |= _BV(digitalPinToPCICRbit(BTN2));
+  *digitalPinToPCICR(RTC_PIN) |= _BV(digitalPinToPCICRbit(RTC_PIN));
+  EIMSK &= ~_BV(INT1);
+  nightSqwLevel = digitalRead(RTC_PIN);
+
+  // a button pressed before the pin change interrupt was armed would
+  // only wake up the CPU when it is released, so it is handled first
+
+  if (HIGH == digitalRead(BTN1) && HIGH == digitalRead(BTN2)) {
+    nightPowerDown = true;
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_enable();
+    interrupts();
+    sleep_cpu();
+    sleep_disable();
+  }
+
+  noInterrupts();
+  nightPowerDown = false;
+  *digitalPinToPCICR(BTN2) &= ~_BV(digitalPinToPCICRbit(BTN2));
+  *digitalPinToPCICR(RTC_PIN) &= ~_BV(digitalPinToPCICRbit(RTC_PIN));
+  EIFR = _BV(INTF1);
+  EIMSK |= _BV(INT1);
+  interrupts();
 }
 
+#ifdef ALPHACLOCK_STATS
 
 // --------------------------------------------------------------------------
-// Set time of RTC with current set values
+// Count awake time and display brightness once per second
 // --------------------------------------------------------------------------
 
-void setRTCTime()
+void updateEnergy()
 {
-  if (!rtcFound) {
+  noInterrupts();
+  unsigned long second = tickSeconds;
+  interrupts();
+  if (second == energySecond) {
     return;
   }
+  energySecond = second;
 
-  DateTime now = rtc.now();
-  rtc.adjust(DateTime(now.year(), now.month(), now.day(), setHour, setMinute, setSecond));
+  // micros() only advances while the CPU is not powered down
+
+  unsigned long awake = (micros() - energyLastMicros) / 1000;
+  energyLastMicros = micros();
+  energySeconds++;
+  energyAwakeSum += ((awake > 1000) ? 1000 : awake) / 10;
+  energyDisplaySum += currentBrightness();
+  energyDaySum += dayBrightness();
 }
 
+#endif
+
 // --------------------------------------------------------------------------
-// Loop in time mode
+// Loop in remote text mode
 // --------------------------------------------------------------------------
 
-void loopTime()
+void loopRemote()
 {
-  handleDisplayUpdateFunction(displayTime);
+  if (millis() - lastRemoteFrame > REMOTE_TIMEOUT) {
+    operationMode = OP_TIME;
+    doDisplayUpdate = true;
+    return;
+  }
+
+  const char *text = remoteText[remoteActive];
+
+  if (remoteLength <= 8) {
+    sendText(text);
+  } else {
+    // scroll long messages without blocking, using the same padding
+    // in front and back as scrollText()
+
+    if (millis() - lastRemoteScroll >= REMOTE_SCROLL_DELAY) {
+      lastRemoteScroll = millis();
+
+      char lineout[9];
+      for (int i=0; i<8; i++) {
+        int pos = remoteOffset + i - 8;
+        lineout[i] = (pos >= 0 && pos < remoteLength) ? text[pos] : ' ';
+      }
+      lineout[8] = 0;
+      sendText(lineout);
+
+      remoteOffset++;
+      if (remoteOffset > remoteLength + 8) {
+        remoteOffset = 0;
+      }
+    }
+  }
 
   if (LOW == buttonState1 && !buttonHandled1) {
     setButtonHandled(1, OP_MENU_DEMO, 10000, OP_TIME);
   } else if (LOW == buttonState2 && !buttonHandled2) {
-    setButtonHandled(2, OP_DATE, 5000, OP_TIME);
+    setButtonHandled(2, OP_TIME, 0, OP_TIME);
   }
 }
 
 // --------------------------------------------------------------------------
-// Loop in date mode
+// Check a serial frame type and set the destination for its payload
 // --------------------------------------------------------------------------
 
-void loopDate()
+bool acceptFrame(uint8_t type, uint8_t length)
 {
-  handleDisplayUpdateFunction(displayDate);
-
-  if (LOW == buttonState1 && !buttonHandled1) {
-    setButtonHandled(1, OP_MENU_DEMO, 10000, OP_TIME);
-  } else if (LOW == buttonState2 && !buttonHandled2) {
-    setButtonHandled(2, OP_YEAR, 5000, OP_TIME);
+  frameTarget = NULL;
+
+  switch (type) {
+    case FRAME_TEXT:
+      // text is received into the inactive half of the remote text buffer
+      if (length < sizeof(remoteText[0])) {
+        frameTarget = remoteText[remoteActive ^ 1];
+        return true;
+      }
+      break;
+#ifdef ALPHACLOCK_TRACE
+    case FRAME_TRACE_DUMP:
+      return 0 == length;
+#endif
+    case FRAME_BEACON:
+      // beacons are on the line for all clocks of a chain, they are
+      // only used by followers but no drops for the others
+      if (sizeof(beaconData) == length) {
+        if (SYNC_FOLLOWER == syncMode) {
+          frameTarget = (char *)beaconData;
+        }
+        return true;
+      }
+      break;
+    case FRAME_EVENT:
+      if (length >= 4 && length <= sizeof(eventData)) {
+        frameTarget = (char *)eventData;
+        return true;
+      }
+      break;
   }
+  return false;
 }
 
 // --------------------------------------------------------------------------
-// Loop in year mode
+// Send a serial frame
 // --------------------------------------------------------------------------
 
-void loopYear()
+void sendFrame(uint8_t type, const uint8_t *payload, uint8_t length)
 {
-  handleDisplayUpdateFunction(displayYear);
+  // followers share the line with the master and never send
 
-  if (LOW == buttonState1 && !buttonHandled1) {
-    setButtonHandled(1, OP_MENU_DEMO, 10000, OP_TIME);
-  } else if (LOW == buttonState2 && !buttonHandled2) {
-    setButtonHandled(2, OP_TEMPERATURE, 5000, OP_TIME);
+  if (SYNC_FOLLOWER == syncMode) {
+    return;
+  }
+
+  uint8_t checksum = type ^ length;
+
+  Serial.write(FRAME_STX);
+  Serial.write(type);
+  Serial.write(length);
+  for (uint8_t i=0; i<length; i++) {
+    Serial.write(payload[i]);
+    checksum ^= payload[i];
   }
+  Serial.write(checksum);
 }
 
 // --------------------------------------------------------------------------
-// Loop in temp mode
+// Send a time beacon after the SQW edge (master)
 // --------------------------------------------------------------------------
 
-void loopTemperature()
+void sendBeacon()
 {
-  handleDisplayUpdateFunction(displayTemperature);
-
-  if (LOW == buttonState1 && !buttonHandled1) {
-    setButtonHandled(1, OP_MENU_DEMO, 10000, OP_TIME);
-  } else if (LOW == buttonState2 && !buttonHandled2) {
-    setButtonHandled(2, OP_TIME, 0, OP_TIME);
+  noInterrupts();
+  unsigned long second = tickSeconds;
+  interrupts();
+  if (second == beaconSecond) {
+    return;
   }
+  beaconSecond = second;
+
+  // unix time of the current second (LSB first) and the centiseconds
+  // passed since its start, so a delayed beacon is still exact
+
+  unsigned long now = readClock();
+  uint8_t payload[5] = {
+    (uint8_t)now, (uint8_t)(now >> 8), (uint8_t)(now >> 16), (uint8_t)(now >> 24),
+    tickCentis
+  };
+  sendFrame(FRAME_BEACON, payload, sizeof(payload));
 }
 
 // --------------------------------------------------------------------------
-// Loop for menu - "demo"
+// Compare a received beacon with the own clock (follower)
 // --------------------------------------------------------------------------
 
-void loopMenuDemo()
+void handleBeacon()
 {
-  handleDisplayUpdateText("DEMO");
-  
-  if (LOW == buttonState1 && !buttonHandled1) {
+  unsigned long epoch = (unsigned long)beaconData[0] | (unsigned long)beaconData[1] << 8
+    | (unsigned long)beaconData[2] << 16 | (unsigned long)beaconData[3] << 24;
+  uint8_t phase = beaconData[4];
+  if (phase > 99 || syncPending) {
+    return;
+  }
 
-    setButtonHandled(1, OP_MENU_SETTIME, 10000, OP_TIME);
-  } else if (LOW == buttonState2 && !buttonHandled2) {
-    buttonHandled2 = true;
-    for(int n=0; n<20; n++) {
-      sendText("--------");
-      delay(50);
-      sendText("\\\\\\\\\\\\\\\\");
-      delay(50);
-      sendText("11111111");
-      delay(50);
-      sendText("////////");
-      delay(50);
+  // read the own second and its centiseconds, again if the second
+  // changed while reading the clock
+
+  unsigned long second, now;
+  uint8_t centis;
+  do {
+    noInterrupts();
+    second = tickSeconds;
+    centis = tickCentis;
+    interrupts();
+    now = readClock();
+  } while (second != tickSeconds);
+
+  long seconds = (long)(epoch - now);
+  if (seconds > -SYNC_MAX_SECONDS && seconds < SYNC_MAX_SECONDS) {
+    long offset = seconds * 100 + phase - centis;
+    if (offset >= -SYNC_THRESHOLD && offset <= SYNC_THRESHOLD) {
+      return;
     }
-    scrollText("!\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_");
-    doDisplayUpdate = true;
-    modeTimeout = 10000;
   }
+
+  // setting the RTC restarts its second, so it is set with the next
+  // second of the master when that second starts
+
+  syncTime = epoch + 1;
+  syncAt = millis() + (100 - phase) * 10UL;
+  syncPending = true;
 }
 
 // --------------------------------------------------------------------------
-// Loop for menu - "set time"
+// Set the clock at the time prepared from a beacon (follower)
 // --------------------------------------------------------------------------
 
-void loopMenuSetTime()
+void checkSync()
 {
-  handleDisplayUpdateText("SET TIME");
+  if (syncPending && (long)(millis() - syncAt) >= 0) {
+    syncPending = false;
+    adjustClock(syncTime);
+  }
+}
 
-  if (LOW == buttonState1 && !buttonHandled1) {
-    setButtonHandled(1, OP_MENU_SETDATE, 10000, OP_TIME);
-  } else if (LOW == buttonState2 && !buttonHandled2) {
-    buttonHandled2 = true;
-    if (!rtcFound) {
-      sendText("NO RTC");
-      delay(1000);
-    } else {
-      operationMode = OP_SET_HOUR;
-      modeTimeout = 0;
-      secondChanged = false;
-      doDisplayUpdate = true;
-    }
+#ifdef ALPHACLOCK_TRACE
+
+// --------------------------------------------------------------------------
+// Send the trace buffer as serial frames and restart the capture
+// --------------------------------------------------------------------------
+
+void dumpTrace()
+{
+  noInterrupts();
+  unsigned int length = traceLength;
+  interrupts();
+
+  // an empty frame marks the end of the trace
+
+  for (unsigned int pos=0; pos<length; pos+=63) {
+    sendFrame(FRAME_TRACE_DATA, &traceBuffer[pos], min(length - pos, 63u));
   }
+  sendFrame(FRAME_TRACE_DATA, NULL, 0);
+
+  noInterrupts();
+  traceLength = 0;
+  lastTraceTime = millis();
+#ifdef ALPHACLOCK_TRACE_RTC
+  lastTraceRTC = 0;
+#endif
+  interrupts();
 }
 
+#endif
+
 // --------------------------------------------------------------------------
-// Loop for menu - "set date"
+// Get the minute of day of an event, EVENT_UNUSED for an empty record
 // --------------------------------------------------------------------------
 
-void loopMenuSetDate()
+int readEventMinute(uint8_t event)
 {
-  handleDisplayUpdateText("SET DATE");
+  int address = STORAGE_EVENTS + event * EVENT_RECORD_SIZE;
+  return (EEPROM.read(address) | EEPROM.read(address + 1) << 8) & EVENT_UNUSED;
+}
 
-  if (LOW == buttonState1 && !buttonHandled1) {
-    setButtonHandled(1, OP_MENU_SETBRIGHTNESS, 10000, OP_TIME);
-  } else if (LOW == buttonState2 && !buttonHandled2) {
-    buttonHandled2 = true;
-    if (!rtcFound) {
-      sendText("NO RTC");
-      delay(1000);
-    } else {
-      operationMode = OP_SET_YEAR;
-      modeTimeout = 0;
-      doDisplayUpdate = true;
+// --------------------------------------------------------------------------
+// Read the text of an event, returns its length
+// --------------------------------------------------------------------------
+
+uint8_t readEventText(uint8_t event, char *text)
+{
+  int address = STORAGE_EVENTS + event * EVENT_RECORD_SIZE;
+  uint8_t length = EEPROM.read(address + 1) >> 3;
+  if (length > EVENT_TEXT_LENGTH) {
+    length = 0;
+  }
+
+  // characters are stored with 6 bits each as offset to the space
+
+  for (uint8_t i=0; i<length; i++) {
+    int bit = i * 6;
+    int pos = address + 3 + bit / 8;
+    unsigned int bits = EEPROM.read(pos);
+    if (bit % 8 > 2) {
+      bits |= EEPROM.read(pos + 1) << 8;
     }
+    text[i] = ' ' + ((bits >> (bit % 8)) & 0x3F);
   }
+  text[length] = 0;
+  return length;
 }
 
 // --------------------------------------------------------------------------
-// Loop for menu - "set brightness"
+// Store an event, EVENT_UNUSED as minute deletes it
 // --------------------------------------------------------------------------
 
-void loopMenuSetBrightness()
+void writeEvent(uint8_t event, int minute, uint8_t days, const char *text, uint8_t length)
 {
-  handleDisplayUpdateText("LIGHT");
+  int address = STORAGE_EVENTS + event * EVENT_RECORD_SIZE;
+  uint8_t record[EVENT_RECORD_SIZE];
 
-  if (LOW == buttonState1 && !buttonHandled1) {
-    setButtonHandled(1, OP_MENU_EXIT, 10000, OP_TIME);
-  } else if (LOW == buttonState2 && !buttonHandled2) {
-    buttonHandled2 = true;
-    operationMode = OP_SET_BRIGHTNESS;
-    modeTimeout = 0;
-    doDisplayUpdate = true;
+  memset(record, 0, sizeof(record));
+  if (EVENT_UNUSED == minute) {
+    memset(record, 0xFF, 3);
+  } else {
+    record[0] = minute;
+    record[1] = minute >> 8 | length << 3;
+    record[2] = days;
+    for (uint8_t i=0; i<length; i++) {
+      char c = text[i];
+      if (c >= 'a' && c <= 'z') {
+        c -= 'a' - 'A';
+      } else if (c < ' ' || c > '_') {
+        c = '?';
+      }
+      int bit = i * 6;
+      unsigned int bits = (c - ' ') << (bit % 8);
+      record[3 + bit / 8] |= bits;
+      if (bit % 8 > 2) {
+        record[4 + bit / 8] |= bits >> 8;
+      }
+    }
+  }
+
+  // only changed bytes are written to save EEPROM cycles
+
+  for (uint8_t i=0; i<EVENT_RECORD_SIZE; i++) {
+    EEPROM.update(address + i, record[i]);
+  }
+  eventsValid = false;
+}
+
+// --------------------------------------------------------------------------
+// Build the sorted index of the events of a day
+// --------------------------------------------------------------------------
+
+void buildEventIndex(uint8_t dayOfWeek, int minute)
+{
+  // insertion sort, only done once per day or after a change
+
+  eventCount = 0;
+  for (uint8_t event=0; event<EVENT_COUNT; event++) {
+    int address = STORAGE_EVENTS + event * EVENT_RECORD_SIZE;
+    int eventMinute = readEventMinute(event);
+    if (eventMinute >= 1440 || !(EEPROM.read(address + 2) & _BV(dayOfWeek))) {
+      continue;
+    }
+    uint8_t pos = eventCount++;
+    while (pos > 0 && readEventMinute(eventIndex[pos - 1]) > eventMinute) {
+      eventIndex[pos] = eventIndex[pos - 1];
+      pos--;
+    }
+    eventIndex[pos] = event;
+  }
+
+  // events which already passed today are not shown any more
+
+  eventNext = 0;
+  while (eventNext < eventCount && readEventMinute(eventIndex[eventNext]) < minute) {
+    eventNext++;
   }
+  eventDay = dayOfWeek;
+  eventsValid = true;
 }
 
 // --------------------------------------------------------------------------
-// Loop for menu - "exit"
+// Handle a complete serial frame
 // --------------------------------------------------------------------------
 
-void loopMenuExit()
+void handleFrame(uint8_t type, uint8_t length)
 {
-  handleDisplayUpdateText("EXIT");
+  switch (type) {
+    case FRAME_TEXT:
+      remoteText[remoteActive ^ 1][length] = 0;
 
-  if (LOW == buttonState1 && !buttonHandled1) {
-    setButtonHandled(1, OP_MENU_DEMO, 10000, OP_TIME);
-  } else if (LOW == buttonState2 && !buttonHandled2) {
-    setButtonHandled(2, OP_TIME, 0, OP_TIME);
+      // only restart scrolling if the text changed
+
+      if (strcmp(remoteText[0], remoteText[1]) != 0) {
+        remoteOffset = 0;
+        lastRemoteScroll = millis() - REMOTE_SCROLL_DELAY;
+      }
+      remoteActive ^= 1;
+      remoteLength = length;
+      lastRemoteFrame = millis();
+
+      // remote text replaces the display modes, but not menus or settings
+
+      if (OP_TIME == operationMode || OP_DATE == operationMode
+        || OP_YEAR == operationMode || OP_TEMPERATURE == operationMode) {
+        operationMode = OP_REMOTE;
+        modeTimeout = 0;
+      }
+      break;
+#ifdef ALPHACLOCK_TRACE
+    case FRAME_TRACE_DUMP:
+      dumpTrace();
+      break;
+#endif
+    case FRAME_BEACON:
+      if (SYNC_FOLLOWER == syncMode) {
+        handleBeacon();
+      }
+      break;
+    case FRAME_EVENT:
+      // number of the record, minute of day (LSB first), days and text
+      if (eventData[0] < EVENT_COUNT) {
+        uint16_t minute = eventData[1] | (uint16_t)eventData[2] << 8;
+        if (minute >= 1440) {
+          minute = EVENT_UNUSED;
+        }
+        writeEvent(eventData[0], minute, eventData[3], (const char *)&eventData[4], length - 4);
+      }
+      break;
   }
 }
 
 // --------------------------------------------------------------------------
-// Loop for time setting
+// Show an event like a remote text
 // --------------------------------------------------------------------------
 
-void loopSetTime()
+void showEvent(uint8_t event)
 {
-  if (doDisplayUpdate) {
-    doDisplayUpdate = false;
+  uint8_t length = readEventText(event, remoteText[remoteActive ^ 1]);
+  handleFrame(FRAME_TEXT, length);
+}
 
-    if (rtcFound) {
-      DateTime now = rtc.now();
+// --------------------------------------------------------------------------
+// Check the next pending event once per minute
+// --------------------------------------------------------------------------
 
-      if (!secondChanged) {
-        setHour = now.hour();
-        setMinute = now.minute();
-        setSecond = now.second();
-      }
-    }
+void checkEvents()
+{
+  if (localMinute < 0 || (eventsValid && localMinute == eventMinute)) {
+    return;
+  }
 
-    char lineout[9];
+  // the event text is shown through the inactive remote text buffer,
+  // which a text frame may be received into, so it waits for the frame
 
-    snprintf(lineout, 9, "%02d:%02d:%02d", setHour, setMinute, setSecond);
+  if (FRAME_WAIT != frameState) {
+    return;
+  }
 
-    if(0 == blinkTimeout) {
-      int pos = 0;
-      if (OP_SET_MINUTE == operationMode) {
-        pos = 3;
-      } else if (OP_SET_SECOND == operationMode) {
-        pos = 6;
-      }
-      lineout[pos] = ' ';
-      lineout[pos+1] = ' ';
-    }
+  // the index is built again for a new day, after a change of the
+  // table and when the time was set back
 
-    sendText(lineout);
+  if (!eventsValid || localDayOfWeek != eventDay || localMinute < eventMinute) {
+    buildEventIndex(localDayOfWeek, localMinute);
   }
+  eventMinute = localMinute;
 
-  if (LOW == buttonState1) {
-    if (!buttonHandled1 || buttonRepeat1) {
-      buttonHandled1 = true;
-      switch (operationMode) {
-        case OP_SET_HOUR:
-          setHour++;
-          if (setHour > 23) {
-            setHour = 0;
-          }
-          setRTCTime();
-          break;
-        case OP_SET_MINUTE:
-          setMinute++;
-          if (setMinute > 59) {
-            setMinute = 0;
-          }
-          setRTCTime();
-          break;
-        case OP_SET_SECOND:
-          secondChanged = true;
-          setSecond++;
-          if (setSecond > 59) {
-            setSecond = 0;
-          }
-          setRTCTime();
-          break;
-      }
-      doDisplayUpdate = true;
-      blinkTimeout = 500;
+  // only the next pending event is compared, if several passed while
+  // the time was not shown the last one is shown if it is recent
 
-      if (buttonRepeat1) {
-        delay(100);
-      }
-    }
-  } else if (LOW == buttonState2 && !buttonHandled2) {
-    buttonHandled2 = true;
-    switch (operationMode) {
-      case OP_SET_HOUR:
-        operationMode = OP_SET_MINUTE;
-        doDisplayUpdate = true;
-        blinkTimeout = 500;
-        break;
-      case OP_SET_MINUTE:
-        operationMode = OP_SET_SECOND;
-        doDisplayUpdate = true;
-        blinkTimeout = 500;
-        break;
-      case OP_SET_SECOND:
-        operationMode = OP_TIME;
-        doDisplayUpdate = true;
-        blinkTimeout = 500;
-        if (secondChanged) {
-          setRTCTime();
-        }
-        break;
+  int due = -1;
+  int dueMinute = 0;
+  while (eventNext < eventCount) {
+    int minute = readEventMinute(eventIndex[eventNext]);
+    if (minute > localMinute) {
+      break;
     }
+    due = eventIndex[eventNext];
+    dueMinute = minute;
+    eventNext++;
+  }
+  if (due >= 0 && localMinute - dueMinute <= EVENT_LATE) {
+    showEvent(due);
   }
 }
 
 // --------------------------------------------------------------------------
-// Loop for date setting
+// Parse received serial data
 // --------------------------------------------------------------------------
 
-void loopSetDate()
+void receiveSerial()
 {
-  if (doDisplayUpdate) {
-    doDisplayUpdate = false;
-
-    if (rtcFound)
-    {
-      DateTime now = rtc.now();
-      setYear = now.year();
-      setMonth = now.month();
-      setDay = now.day();
-    }
-    
-    char lineout[9];
-
-    switch (operationMode) {
-      case OP_SET_YEAR:
-        snprintf(lineout, 9, "Y: %04d", setYear);
-        break;
-      case OP_SET_MONTH:
-        snprintf(lineout, 9, "M: %02d", setMonth);
-        break;
-      case OP_SET_DAY:
-        DateTime date = DateTime(setYear, setMonth, setDay, 0, 0, 0);
-        char *dayoutput = (char *)"??";
-        switch (date.dayOfTheWeek()) {
-          case 0: dayoutput = (char *)"SU";break;
-          case 1: dayoutput = (char *)"MO";break;
-          case 2: dayoutput = (char *)"TU";break;
-          case 3: dayoutput = (char *)"WE";break;
-          case 4: dayoutput = (char *)"TH";break;
-          case 5: dayoutput = (char *)"FR";break;
-          case 6: dayoutput = (char *)"SA";break;
-        }
-        snprintf(lineout, 9, "D: %02d %s", setDay, dayoutput);
-        break;
-    }
-    if (0 == blinkTimeout) {
-      lineout[3] = 0;
-    }
+  // the payload is written directly to its destination while reading from
+  // the receive buffer, so no intermediate frame buffer is needed
 
-    sendText(lineout);
-  }
+  // a frame which stopped in the middle is dropped after a timeout
 
-  bool isLeapYear;
-  if (setYear % 400 == 0) {
-    isLeapYear = true;
-  } else if (setYear % 100 == 0) {
-    isLeapYear = false;
-  } else if (setYear % 4) {
-    isLeapYear = true;
-  } else {
-    isLeapYear = false;
+  if (FRAME_WAIT != frameState && millis() - lastFrameByte > FRAME_TIMEOUT) {
+    remoteDrops++;
+    frameState = FRAME_WAIT;
   }
 
-  if (LOW == buttonState1) {
-    if (!buttonHandled1 || buttonRepeat1) {
-      buttonHandled1 = true;
-      switch (operationMode) {
-        case OP_SET_YEAR:
-          setYear++;
-          if (setYear > 2037) {
-            setYear = 2021;
-          }
-          setRTCDate();
-          break;
-        case OP_SET_MONTH:
-          setMonth++;
-          if (setMonth > 12) {
-            setMonth = 1;
-          }
-          setRTCDate();
-          break;
-        case OP_SET_DAY:
-          setDay++;
-          switch (setMonth) {
-            case 1:
-            case 3:
-            case 6:
-            case 8:
-            case 10:
-            case 12:
-              if (setDay > 31) {
-                setDay = 1;
-              }
-              break;
-            case 2:
-              if (isLeapYear) {
-                if (setDay > 29) {
-                  setDay = 1;
-                }
-              } else {
-                if (setDay > 28) {
-                  setDay = 1;
-                }
-              }
-              break;
-            default:
-              if (setDay > 30) {
-                setDay = 1;
-              }
-              break;
-          }
-          setRTCDate();
-          break;
-      }
-      doDisplayUpdate = true;
-      blinkTimeout = 500;
+  while (Serial.available() > 0) {
+    uint8_t data = Serial.read();
+    lastFrameByte = millis();
 
-      if (buttonRepeat1) {
-        delay(100);
-      }
-    }
-  } else if (LOW == buttonState2 && !buttonHandled2) {
-    buttonHandled2 = true;
-    switch (operationMode) {
-      case OP_SET_YEAR:
-        operationMode = OP_SET_MONTH;
-        doDisplayUpdate = true;
-        blinkTimeout = 500;
+    switch (frameState) {
+      case FRAME_WAIT:
+        if (FRAME_STX == data) {
+          frameState = FRAME_TYPE;
+        }
         break;
-      case OP_SET_MONTH:
-        operationMode = OP_SET_DAY;
-        doDisplayUpdate = true;
-        blinkTimeout = 500;
+      case FRAME_TYPE:
+        frameType = data;
+        frameChecksum = data;
+        frameState = FRAME_LENGTH;
         break;
-      case OP_SET_DAY:
-        operationMode = OP_TIME;
-        doDisplayUpdate = true;
-        blinkTimeout = 500;
+      case FRAME_LENGTH:
+        frameLength = data;
+        frameChecksum ^= data;
+        framePos = 0;
+        frameAccepted = acceptFrame(frameType, frameLength);
+        frameState = frameLength > 0 ? FRAME_PAYLOAD : FRAME_CHECKSUM;
+        break;
+      case FRAME_PAYLOAD:
+        if (frameTarget) {
+          frameTarget[framePos] = data;
+        }
+        frameChecksum ^= data;
+        framePos++;
+        if (framePos == frameLength) {
+          frameState = FRAME_CHECKSUM;
+        }
+        break;
+      case FRAME_CHECKSUM:
+        if (frameAccepted && data == frameChecksum) {
+          remoteFrames++;
+          handleFrame(frameType, frameLength);
+        } else {
+          remoteDrops++;
+        }
+        frameState = FRAME_WAIT;
         break;
     }
   }
 }
 
 // --------------------------------------------------------------------------
-// Loop for brightness setting
+// Report runtime statistics
 // --------------------------------------------------------------------------
 
-void loopSetBrightness()
+#ifdef ALPHACLOCK_STATS
+void printStat(const __FlashStringHelper *name, unsigned long value)
 {
-  if (doDisplayUpdate) {
-    doDisplayUpdate = false;
-    
-    char lineout[9];
-
-    snprintf(lineout, 9, "L: %03d%%", displayBrightness);
-
-    if(0 == blinkTimeout) {
-      lineout[3] = 0;
-    }
+  Serial.print(' ');
+  Serial.print(name);
+  Serial.print('=');
+  Serial.print(value);
+}
 
-    sendText(lineout);
+void reportStats()
+{
+  if (millis() - lastStatsReport < STATS_INTERVAL) {
+    return;
   }
+  lastStatsReport += STATS_INTERVAL;
 
-  if (LOW == buttonState1) {
-    if (!buttonHandled1 || buttonRepeat1) {
-      buttonHandled1 = true;
-      displayBrightness += 5;
-      if (displayBrightness > 100) {
-        displayBrightness = 10;
-      }
-      analogWrite(PWM_OUT, displayBrightness * 255 / 100);
-      doDisplayUpdate = true;
-      blinkTimeout = 500;
+  // followers share the line with the master and never send
 
-      if (buttonRepeat1) {
-        delay(100);
-      }
-    }
-  } else if (LOW == buttonState2 && !buttonHandled2) {
-    buttonHandled2 = true;
-    operationMode = OP_TIME;
-    doDisplayUpdate = true;
-    blinkTimeout = 500;
+  if (SYNC_FOLLOWER == syncMode) {
+    return;
+  }
 
-    EEPROM.write(STORAGE_BRIGHTNESS, displayBrightness);
+  Serial.print(F("STATS"));
+  printStat(F("latency_us"), updateLatency);
+  printStat(F("latency_max_us"), updateLatencyMax);
+  printStat(F("char_us"), display.charCost());
+  printStat(F("boot_us"), bootLatency);
+  printStat(F("rtc_probe_us"), rtcProbeTime);
+  printStat(F("rtc_probe_max_us"), rtcProbeTimeMax);
+  printStat(F("rtc_losses"), rtcLosses);
+  printStat(F("rtc_read_errors"), rtcReadErrors);
+#ifdef ALPHACLOCK_TIMEWARP
+  unsigned long warpTime = readClock();
+  printStat(F("warp_sps"), (warpTime - lastStatsWarpTime) * 1000 / STATS_INTERVAL);
+  printStat(F("warp_time"), warpTime);
+  lastStatsWarpTime = warpTime;
+  printStat(F("warp_checks"), warpChecks);
+  printStat(F("warp_errors"), warpErrors);
+#endif
+  printStat(F("remote_fps"), (remoteFrames - lastStatsFrames) * 1000 / STATS_INTERVAL);
+  printStat(F("remote_frames"), remoteFrames);
+  printStat(F("remote_drops"), remoteDrops);
+  if (energySeconds > 0) {
+    // compared to the CPU always awake and the display at the
+    // brightness it would have without the night schedule
+
+    unsigned long awakePct = energyAwakeSum / energySeconds;
+    unsigned long displayPct = energyDisplaySum / energySeconds;
+    unsigned long dimmedPct = (energyDaySum - energyDisplaySum) / energySeconds;
+    printStat(F("awake_pct"), awakePct);
+    printStat(F("display_pct"), displayPct);
+    printStat(F("saved_mah_day"), ((100 - awakePct) * MCU_CURRENT + dimmedPct * DISPLAY_CURRENT) * 24 / 100);
   }
+#ifdef LIGHT_SENSOR
+  printStat(F("light_adc"), lightFiltered / 16);
+  printStat(F("light_pct"), lightLevel);
+#endif
+  lastStatsFrames = remoteFrames;
+  Serial.println();
 }
+#endif
 
 // --------------------------------------------------------------------------
 // Main loop
@@ -951,17 +3718,20 @@ void loop() {
   
   readButtonDebounced(1);
   readButtonDebounced(2);
-  
-  // If no RTC is present, keep display update running in software
 
-  if (!rtcFound) {
-    if (millis() - lastSoftTimeout > 999) {
-      blinkTimeout = 500;
-      doDisplayUpdate = true;
-      lastSoftTimeout = millis();
-    }
-  }
+  // Detect loss and return of the RTC module
+
+  checkRTC();
 
+  // Handle frames received on the serial port and the time distribution
+
+  receiveSerial();
+  if (SYNC_MASTER == syncMode) {
+    sendBeacon();
+  } else if (SYNC_FOLLOWER == syncMode) {
+    checkSync();
+  }
+  
   // Blink timer
 
   if (blinkTimeout > 1) {
@@ -977,9 +3747,28 @@ void loop() {
     modeTimeout--;
     if (0 == modeTimeout) {
       operationMode = modeTarget;
+      doDisplayUpdate = true;
     }
   }
 
+  // A prerendered time frame is only valid while the time is displayed
+
+  if (OP_TIME != operationMode) {
+    nextTimeFrameValid = false;
+  }
+
+#ifdef LIGHT_SENSOR
+  // Automatic brightness, not while the brightness is set manually
+
+  if (autoBrightness && OP_SET_BRIGHTNESS != operationMode && !nightDark) {
+    updateAutoBrightness();
+  }
+#endif
+
+  // Night schedule
+
+  updateNight();
+
   // Handle current operation mode
   
   switch (operationMode) {
@@ -998,6 +3787,9 @@ void loop() {
     case OP_MENU_DEMO:
       loopMenuDemo();
       break;
+    case OP_DEMO:
+      loopDemo();
+      break;
     case OP_MENU_SETTIME:
       loopMenuSetTime();
       break;
@@ -1023,7 +3815,69 @@ void loop() {
     case OP_SET_BRIGHTNESS:
       loopSetBrightness();
       break;
+    case OP_INFO:
+      loopInfo();
+      break;
+    case OP_REMOTE:
+      loopRemote();
+      break;
+    case OP_MENU_STOPWATCH:
+      loopMenuStopwatch();
+      break;
+    case OP_MENU_COUNTDOWN:
+      loopMenuCountdown();
+      break;
+    case OP_STOPWATCH:
+      loopStopwatch();
+      break;
+    case OP_SET_COUNTDOWN:
+      loopSetCountdown();
+      break;
+    case OP_COUNTDOWN:
+      loopCountdown();
+      break;
+    case OP_MENU_SETTRIM:
+      loopMenuSetTrim();
+      break;
+    case OP_SET_TRIM:
+      loopSetTrim();
+      break;
+    case OP_MENU_SETZONE:
+      loopMenuSetZone();
+      break;
+    case OP_SET_ZONE:
+      loopSetZone();
+      break;
+    case OP_MENU_SETNIGHT:
+      loopMenuSetNight();
+      break;
+    case OP_SET_NIGHT_MODE:
+    case OP_SET_NIGHT_START:
+    case OP_SET_NIGHT_END:
+      loopSetNight();
+      break;
+    case OP_MENU_SETSYNC:
+      loopMenuSetSync();
+      break;
+    case OP_SET_SYNC:
+      loopSetSync();
+      break;
+  }
+
+  // Scheduled events, only while the time is shown
+
+  if (OP_TIME == operationMode) {
+    checkEvents();
   }
 
-  delay(1);
+#ifdef ALPHACLOCK_STATS
+  updateEnergy();
+  reportStats();
+#endif
+
+  if (nightDark) {
+    sleepNight();
+  } else {
+    delay(1);
+  }
 }
@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+"""
+AlphaClock animation compiler
+
+Compiles a text description of a display animation into a byte array which
+is stored in flash and decoded one frame at a time by the clock.
+
+Usage: animc.py INPUT.anim OUTPUT.h
+
+Description format (one statement per line, # starts a comment):
+
+  frame MS "TEXT"      show up to 8 characters for MS milliseconds
+  scroll MS "TEXT"     scroll text through the display, MS per step
+  repeat N             repeat the following frames N times (no nesting)
+  end                  end of the repeated frames
+
+Durations are stored in steps of 10 ms (10 to 2550 ms).
+
+Encoded records:
+
+  0x00                         end of animation
+  0x01 DUR (COUNT CHAR)...     keyframe, run length encoded up to 8 chars
+  0x02 DUR MASK CHAR...        delta frame, one char per set bit in MASK
+                               (bit 7 = first position)
+  0x03 DUR LEN CHAR...         scroll text with 8 blanks in front and back
+  0x04 COUNT                   start of repeated frames
+  0x05                         end of repeated frames
+
+Copyright 2021-2023 Arno Welzel / https://arnowelzel.de
+License: GPL 3 or later
+"""
+
+import ast
+import os
+import sys
+
+ANIM_END = 0x00
+ANIM_KEY = 0x01
+ANIM_DELTA = 0x02
+ANIM_SCROLL = 0x03
+ANIM_REPEAT = 0x04
+ANIM_LOOP = 0x05
+
+DISPLAY_LENGTH = 8
+FIRST_CHAR = 0x20
+LAST_CHAR = 0x5f
+
+
+class AnimationError(Exception):
+    pass
+
+
+def parse_duration(value):
+    if not value.endswith('ms'):
+        raise AnimationError('duration must be given in ms: ' + value)
+    duration = int(value[:-2])
+    if duration % 10 or not 10 <= duration <= 2550:
+        raise AnimationError('duration must be 10 to 2550 ms in steps of 10 ms: ' + value)
+    return duration // 10
+
+
+def parse_text(value, pad):
+    text = ast.literal_eval(value)
+    if not isinstance(text, str):
+        raise AnimationError('text must be quoted: ' + value)
+    text = text.upper()
+    for char in text:
+        if not FIRST_CHAR <= ord(char) <= LAST_CHAR:
+            raise AnimationError('character can not be shown: ' + repr(char))
+    if pad:
+        if len(text) > DISPLAY_LENGTH:
+            raise AnimationError('frame text longer than 8 characters: ' + value)
+        text = text.ljust(DISPLAY_LENGTH)
+    elif not 1 <= len(text) <= 255:
+        raise AnimationError('scroll text must have 1 to 255 characters')
+    return text
+
+
+def encode_key(text):
+    data = []
+    pos = 0
+    while pos < len(text):
+        count = 1
+        while pos + count < len(text) and text[pos + count] == text[pos]:
+            count += 1
+        data += [count, ord(text[pos])]
+        pos += count
+    return data
+
+
+def encode_delta(previous, text):
+    mask = 0
+    chars = []
+    for pos in range(DISPLAY_LENGTH):
+        if text[pos] != previous[pos]:
+            mask |= 0x80 >> pos
+            chars.append(ord(text[pos]))
+    return [mask] + chars
+
+
+def compile_animation(lines):
+    data = []
+    shown = None
+    repeating = False
+
+    for number, line in enumerate(lines, 1):
+        line = line.strip()
+        if not line or line.startswith('#'):
+            continue
+        try:
+            words = line.split(None, 2)
+            command = words[0]
+            if command == 'frame' and len(words) == 3:
+                duration = parse_duration(words[1])
+                text = parse_text(words[2], True)
+
+                # a delta frame is only possible when the shown text is
+                # known, which is not the case at the start of a repeat
+
+                key = encode_key(text)
+                if shown is not None:
+                    delta = encode_delta(shown, text)
+                    if len(delta) < len(key):
+                        data += [ANIM_DELTA, duration] + delta
+                        shown = text
+                        continue
+                data += [ANIM_KEY, duration] + key
+                shown = text
+            elif command == 'scroll' and len(words) == 3:
+                duration = parse_duration(words[1])
+                text = parse_text(words[2], False)
+                data += [ANIM_SCROLL, duration, len(text)] + [ord(c) for c in text]
+                shown = ' ' * DISPLAY_LENGTH
+            elif command == 'repeat' and len(words) == 2:
+                if repeating:
+                    raise AnimationError('repeat can not be nested')
+                count = int(words[1])
+                if not 1 <= count <= 255:
+                    raise AnimationError('repeat count must be 1 to 255')
+                data += [ANIM_REPEAT, count]
+                repeating = True
+                shown = None
+            elif command == 'end' and len(words) == 1:
+                if not repeating:
+                    raise AnimationError('end without repeat')
+                data += [ANIM_LOOP]
+                repeating = False
+                shown = None
+            else:
+                raise AnimationError('invalid statement')
+        except (AnimationError, ValueError, SyntaxError) as error:
+            raise AnimationError('line %d: %s' % (number, error))
+
+    if repeating:
+        raise AnimationError('missing end of repeat')
+    return data + [ANIM_END]
+
+
+def write_header(name, source, data, output):
+    symbol = name.upper() + '_ANIMATION'
+    output.write('// generated by tools/animc.py from %s, do not edit\n\n' % source)
+    output.write('#pragma once\n\n')
+    output.write('const uint8_t %s[] PROGMEM = {\n' % symbol)
+    for pos in range(0, len(data), 12):
+        output.write('  ' + ', '.join('0x%02x' % byte for byte in data[pos:pos + 12]) + ',\n')
+    output.write('};\n')
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__.strip().split('\n\n')[2])
+        return 1
+
+    source, target = sys.argv[1:3]
+    name = os.path.splitext(os.path.basename(source))[0]
+    with open(source) as input_file:
+        try:
+            data = compile_animation(input_file.readlines())
+        except AnimationError as error:
+            print('%s: %s' % (source, error), file=sys.stderr)
+            return 1
+    with open(target, 'w') as output:
+        write_header(name, source, data, output)
+    print('%s: %d bytes' % (target, len(data)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
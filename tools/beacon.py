@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""
+AlphaClock time beacon master
+
+Sends time beacons with the system time of the host, so it can act as the
+master for clocks set to SYNC RECV. The system time should be synchronized
+with NTP. Do not use it together with a clock set to SYNC SEND on the
+same line.
+
+Usage: beacon.py PORT
+       beacon.py --offset SECONDS PORT
+
+With --offset the beacons are sent with the given offset to the system
+time, which makes the followers set their clocks for testing.
+
+Copyright 2021-2023 Arno Welzel / https://arnowelzel.de
+License: GPL 3 or later
+"""
+
+import struct
+import sys
+import time
+
+STX = 0x02
+FRAME_BEACON = ord('B')
+
+
+def build_frame(frame_type, payload=b''):
+    checksum = frame_type ^ len(payload)
+    for byte in payload:
+        checksum ^= byte
+    return bytes([STX, frame_type, len(payload)]) + payload + bytes([checksum])
+
+
+def send_beacons(device, offset):
+    import serial
+
+    with serial.Serial(device, 115200) as port:
+        while True:
+            # wait for the start of the next second like the clock waits
+            # for the SQW edge
+
+            now = time.time()
+            time.sleep(1 - now % 1)
+            now = time.time()
+            second = int(now)
+            phase = min(int((now - second) * 100), 99)
+            port.write(build_frame(FRAME_BEACON, struct.pack('<IB', second + offset, phase)))
+            print('%d.%02d' % (second + offset, phase))
+
+
+def main():
+    args = sys.argv[1:]
+    offset = 0
+    if len(args) == 3 and args[0] == '--offset':
+        offset = int(args[1])
+        args = args[2:]
+    if len(args) != 1:
+        print('Usage: beacon.py PORT')
+        print('       beacon.py --offset SECONDS PORT')
+        sys.exit(1)
+
+    try:
+        send_beacons(args[0], offset)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""
+AlphaClock event loader
+
+Stores the events of a text file in the clock over the serial port. Each
+line contains the time, the days of week and the text to show (up to 16
+characters), empty lines and lines starting with # are ignored:
+
+  06:00 MO-FR SHIFT CHANGE
+  13:45 MO,WE MEETING 14:00
+  22:00 *     GOOD NIGHT
+
+All other records of the clock (up to 64) are deleted.
+
+Usage: events.py PORT EVENTS.txt
+
+Copyright 2021-2023 Arno Welzel / https://arnowelzel.de
+License: GPL 3 or later
+"""
+
+import struct
+import sys
+import time
+
+STX = 0x02
+FRAME_EVENT = ord('E')
+
+EVENT_COUNT = 64
+EVENT_TEXT_LENGTH = 16
+EVENT_DELETE = 0xffff
+DAYS = ['SU', 'MO', 'TU', 'WE', 'TH', 'FR', 'SA']
+
+
+def build_frame(frame_type, payload=b''):
+    checksum = frame_type ^ len(payload)
+    for byte in payload:
+        checksum ^= byte
+    return bytes([STX, frame_type, len(payload)]) + payload + bytes([checksum])
+
+
+def parse_days(value):
+    if value == '*':
+        return 0x7f
+    mask = 0
+    for part in value.upper().split(','):
+        if '-' in part:
+            first, last = (DAYS.index(day) for day in part.split('-'))
+            for day in range(first, last + 1):
+                mask |= 1 << day
+        else:
+            mask |= 1 << DAYS.index(part)
+    return mask
+
+
+def parse_events(lines):
+    events = []
+    for number, line in enumerate(lines, 1):
+        line = line.strip()
+        if not line or line.startswith('#'):
+            continue
+        try:
+            clock, days, text = line.split(None, 2)
+            hour, minute = (int(value) for value in clock.split(':'))
+            if not (0 <= hour < 24 and 0 <= minute < 60):
+                raise ValueError('invalid time')
+            if len(text) > EVENT_TEXT_LENGTH:
+                raise ValueError('text longer than %d characters' % EVENT_TEXT_LENGTH)
+            events.append((hour * 60 + minute, parse_days(days), text.upper()))
+        except ValueError as error:
+            raise ValueError('line %d: %s' % (number, error))
+    if len(events) > EVENT_COUNT:
+        raise ValueError('more than %d events' % EVENT_COUNT)
+    return events
+
+
+def main():
+    if len(sys.argv) != 3:
+        print('Usage: events.py PORT EVENTS.txt')
+        sys.exit(1)
+
+    with open(sys.argv[2]) as file:
+        try:
+            events = parse_events(file.readlines())
+        except ValueError as error:
+            print('%s: %s' % (sys.argv[2], error), file=sys.stderr)
+            sys.exit(1)
+
+    import serial
+
+    with serial.Serial(sys.argv[1], 115200) as port:
+        for record in range(EVENT_COUNT):
+            if record < len(events):
+                minute, days, text = events[record]
+                payload = struct.pack('<BHB', record, minute, days) + text.encode('ascii')
+            else:
+                payload = struct.pack('<BHB', record, EVENT_DELETE, 0)
+            port.write(build_frame(FRAME_EVENT, payload))
+
+            # the clock needs up to 50 ms to write a record to the EEPROM
+
+            time.sleep(0.1)
+    print('%d events stored' % len(events))
+
+
+if __name__ == '__main__':
+    main()
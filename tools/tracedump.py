@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""
+AlphaClock trace dump
+
+Requests the event trace of a clock built with ALPHACLOCK_TRACE over the
+serial port, stores it as binary file and prints the decoded events.
+An existing binary trace can be decoded with --decode.
+
+Usage: tracedump.py PORT OUTPUT.bin
+       tracedump.py --decode TRACE.bin
+
+Copyright 2021-2023 Arno Welzel / https://arnowelzel.de
+License: GPL 3 or later
+"""
+
+import struct
+import sys
+
+STX = 0x02
+FRAME_TRACE_DUMP = ord('D')
+FRAME_TRACE_DATA = ord('d')
+
+TRACE_IDLE = 0
+TRACE_BUTTON1 = 1
+TRACE_BUTTON2 = 2
+TRACE_SQW = 3
+TRACE_RTC_READ = 4
+TRACE_RTC_NEXT = 5
+
+PAYLOAD_LENGTH = {
+    TRACE_IDLE: 0,
+    TRACE_BUTTON1: 1,
+    TRACE_BUTTON2: 1,
+    TRACE_SQW: 0,
+    TRACE_RTC_READ: 4,
+    TRACE_RTC_NEXT: 0,
+}
+
+
+def build_frame(frame_type, payload=b''):
+    checksum = frame_type ^ len(payload)
+    for byte in payload:
+        checksum ^= byte
+    return bytes([STX, frame_type, len(payload)]) + payload + bytes([checksum])
+
+
+def read_frame(port):
+    while True:
+        data = port.read(1)
+        if not data:
+            raise TimeoutError('no answer from clock')
+        if data[0] == STX:
+            break
+    frame_type, length = port.read(2)
+    payload = port.read(length)
+    checksum = port.read(1)[0]
+    expected = frame_type ^ length
+    for byte in payload:
+        expected ^= byte
+    if checksum != expected:
+        raise ValueError('checksum error')
+    return frame_type, payload
+
+
+def request_trace(device):
+    import serial
+
+    with serial.Serial(device, 115200, timeout=2) as port:
+        port.write(build_frame(FRAME_TRACE_DUMP))
+        trace = b''
+        while True:
+            frame_type, payload = read_frame(port)
+            if frame_type != FRAME_TRACE_DATA:
+                continue
+            if not payload:
+                return trace
+            trace += payload
+
+
+def decode(trace):
+    """Yield (time in ms since capture start, event type, value)."""
+    pos = 0
+    time = 0
+    rtc = None
+    while pos + 3 <= len(trace):
+        delta, event = struct.unpack_from('<HB', trace, pos)
+        pos += 3
+        length = PAYLOAD_LENGTH.get(event)
+        if length is None:
+            raise ValueError('unknown event %d at offset %d' % (event, pos - 3))
+        payload = trace[pos:pos + length]
+        pos += length
+        time += delta
+        if event == TRACE_IDLE:
+            continue
+        if event == TRACE_RTC_READ:
+            value = rtc = struct.unpack('<I', payload)[0]
+        elif event == TRACE_RTC_NEXT and rtc is not None:
+            event = TRACE_RTC_READ
+            value = rtc = rtc + 1
+        elif length:
+            value = payload[0]
+        else:
+            value = None
+        yield time, event, value
+
+
+def main():
+    if len(sys.argv) == 3 and sys.argv[1] == '--decode':
+        with open(sys.argv[2], 'rb') as file:
+            trace = file.read()
+    elif len(sys.argv) == 3:
+        trace = request_trace(sys.argv[1])
+        with open(sys.argv[2], 'wb') as file:
+            file.write(trace)
+    else:
+        print('Usage: tracedump.py PORT OUTPUT.bin')
+        print('       tracedump.py --decode TRACE.bin')
+        sys.exit(1)
+
+    names = {
+        TRACE_BUTTON1: 'BTN1',
+        TRACE_BUTTON2: 'BTN2',
+        TRACE_SQW: 'SQW',
+        TRACE_RTC_READ: 'RTC',
+        TRACE_RTC_NEXT: 'RTC+1',
+    }
+    for time, event, value in decode(trace):
+        if value is None:
+            print('%10d %s' % (time, names[event]))
+        else:
+            print('%10d %s %d' % (time, names[event], value))
+
+
+if __name__ == '__main__':
+    main()